@@ -11,14 +11,24 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#ifndef CPU_ONLY
 #include <cuda_runtime.h>
 #include <cuda.h>
+#endif
 
 #define TRUE 1
 #define FALSE 0
 
 #define CSIZE 256 //alphabet's size
 
+#define CPU_MAX_INTERLEAVE 32 //CPU engine: maximum number of (packet, DFA) streams a thread advances in lockstep
+#define CPU_MATCH_VEC_SIZE 64 //CPU engine: initial match capacity per (packet, DFA) cell of a worker, doubled when a cell overflows
+#define CPU_TILE_REUSE 4 //CPU engine: input bytes a tile streams through the state table of its DFA group, in multiples of the table size held in cache
+#define CPU_TILE_MIN_BYTES 65536 //CPU engine: input bytes of the smallest tile, for tables that stay in the L1 cache
+#define CPU_TILES_PER_THREAD 4 //CPU engine: tiles are made smaller when there would be fewer than this many per thread to balance
+#define CPU_DEAD_STATE_CHECK 64 //CPU engine: bytes that lockstep kernels (interleaved, SIMD gather) run between checks for lanes in the dead state
+#define CPU_ACCEL_MAX_ESCAPES 16 //CPU engine: largest number of escape symbols of an accelerated state
+
 typedef unsigned char symbol;//note: each symbol has 1 byte
 typedef unsigned int symboln;//4-byte fetches
 //typedef unsigned long long symbol_fetch;//version 2 -- 8-byte fetches
@@ -32,4 +42,10 @@ typedef struct _match_type{//version 2 -- note: merge two memory transactions in
     unsigned int stat;
 } match_type;
 
+typedef struct _accel_type{//CPU engine: non-accepting state that every input symbol but its escapes leads back to
+    unsigned int n_escapes;
+    symbol escapes[CPU_ACCEL_MAX_ESCAPES];
+    symbol lo[16], hi[16];//shufti masks: symbol c may be an escape if lo[c & 15] & hi[c >> 4] is not 0
+} accel_type;
+
 #endif
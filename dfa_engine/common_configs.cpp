@@ -11,8 +11,28 @@ using namespace std;
 
 CommonConfigs::CommonConfigs() {
 	packets_ = 1;
+	segment_mode_ = 0;
+	overlap_bytes_ = 1024;
 	threads_per_block_ = 64;
 	groups_ = 1;
+	cpu_threads_ = 0;
+	interleave_ = 1;
+	cpu_kernel_ = 0;
+	max_matches_ = 0;
+	report_format_ = 0;
+	merge_reports_ = 0;
+	batch_packets_ = 0;
+	max_flows_ = 0;
+	flow_timeout_ = 120;
+	alphabet_reduction_ = 1;
+	state_width_reduction_ = 1;
+	row_offsets_ = 1;
+	accel_escapes_ = CPU_ACCEL_MAX_ESCAPES;
+	literal_prefilter_ = 2;
+	numa_node_ = -1;
+	numa_replicate_ = 0;
+	huge_pages_ = HOST_PAGES_THP;
+	lock_memory_ = 0;
 	input_file_name_ = NULL;
 }
 
@@ -32,6 +52,90 @@ unsigned int CommonConfigs::get_packets() const {
 	return packets_;
 }
 
+unsigned int CommonConfigs::get_segment_mode() const {
+	return segment_mode_;
+}
+
+unsigned int CommonConfigs::get_overlap_bytes() const {
+	return overlap_bytes_;
+}
+
+unsigned int CommonConfigs::get_cpu_threads() const {
+	return cpu_threads_;
+}
+
+unsigned int CommonConfigs::get_interleave() const {
+	return interleave_;
+}
+
+unsigned int CommonConfigs::get_cpu_kernel() const {
+	return cpu_kernel_;
+}
+
+unsigned int CommonConfigs::get_max_matches() const {
+	return max_matches_;
+}
+
+unsigned int CommonConfigs::get_report_format() const {
+	return report_format_;
+}
+
+unsigned int CommonConfigs::get_merge_reports() const {
+	return merge_reports_;
+}
+
+unsigned int CommonConfigs::get_batch_packets() const {
+	return batch_packets_;
+}
+
+unsigned int CommonConfigs::get_max_flows() const {
+	return max_flows_;
+}
+
+unsigned int CommonConfigs::get_flow_timeout() const {
+	return flow_timeout_;
+}
+
+unsigned int CommonConfigs::get_alphabet_reduction() const {
+	return alphabet_reduction_;
+}
+
+unsigned int CommonConfigs::get_state_width_reduction() const {
+	return state_width_reduction_;
+}
+
+unsigned int CommonConfigs::get_row_offsets() const {
+	return row_offsets_;
+}
+
+unsigned int CommonConfigs::get_accel_escapes() const {
+	return accel_escapes_;
+}
+
+unsigned int CommonConfigs::get_literal_prefilter() const {
+	return literal_prefilter_;
+}
+
+const std::vector<unsigned int> &CommonConfigs::get_cpu_list() const {
+	return cpu_list_;
+}
+
+int CommonConfigs::get_numa_node() const {
+	return numa_node_;
+}
+
+unsigned int CommonConfigs::get_numa_replicate() const {
+	return numa_replicate_;
+}
+
+unsigned int CommonConfigs::get_huge_pages() const {
+	return huge_pages_;
+}
+
+unsigned int CommonConfigs::get_lock_memory() const {
+	return lock_memory_;
+}
+
 const char *CommonConfigs::get_input_file_name() const {
 	return input_file_name_;
 }
@@ -52,6 +156,90 @@ void CommonConfigs::set_packets(unsigned int packets) {
 	packets_ = packets;
 }
 
+void CommonConfigs::set_segment_mode(unsigned int segment_mode) {
+	segment_mode_ = segment_mode;
+}
+
+void CommonConfigs::set_overlap_bytes(unsigned int overlap_bytes) {
+	overlap_bytes_ = overlap_bytes;
+}
+
+void CommonConfigs::set_cpu_threads(unsigned int cpu_threads) {
+	cpu_threads_ = cpu_threads;
+}
+
+void CommonConfigs::set_interleave(unsigned int interleave) {
+	interleave_ = interleave;
+}
+
+void CommonConfigs::set_cpu_kernel(unsigned int cpu_kernel) {
+	cpu_kernel_ = cpu_kernel;
+}
+
+void CommonConfigs::set_max_matches(unsigned int max_matches) {
+	max_matches_ = max_matches;
+}
+
+void CommonConfigs::set_report_format(unsigned int report_format) {
+	report_format_ = report_format;
+}
+
+void CommonConfigs::set_merge_reports(unsigned int merge_reports) {
+	merge_reports_ = merge_reports;
+}
+
+void CommonConfigs::set_batch_packets(unsigned int batch_packets) {
+	batch_packets_ = batch_packets;
+}
+
+void CommonConfigs::set_max_flows(unsigned int max_flows) {
+	max_flows_ = max_flows;
+}
+
+void CommonConfigs::set_flow_timeout(unsigned int flow_timeout) {
+	flow_timeout_ = flow_timeout;
+}
+
+void CommonConfigs::set_alphabet_reduction(unsigned int alphabet_reduction) {
+	alphabet_reduction_ = alphabet_reduction;
+}
+
+void CommonConfigs::set_state_width_reduction(unsigned int state_width_reduction) {
+	state_width_reduction_ = state_width_reduction;
+}
+
+void CommonConfigs::set_row_offsets(unsigned int row_offsets) {
+	row_offsets_ = row_offsets;
+}
+
+void CommonConfigs::set_accel_escapes(unsigned int accel_escapes) {
+	accel_escapes_ = accel_escapes;
+}
+
+void CommonConfigs::set_literal_prefilter(unsigned int literal_prefilter) {
+	literal_prefilter_ = literal_prefilter;
+}
+
+void CommonConfigs::set_cpu_list(const std::vector<unsigned int> &cpu_list) {
+	cpu_list_ = cpu_list;
+}
+
+void CommonConfigs::set_numa_node(int numa_node) {
+	numa_node_ = numa_node;
+}
+
+void CommonConfigs::set_numa_replicate(unsigned int numa_replicate) {
+	numa_replicate_ = numa_replicate;
+}
+
+void CommonConfigs::set_huge_pages(unsigned int huge_pages) {
+	huge_pages_ = huge_pages;
+}
+
+void CommonConfigs::set_lock_memory(unsigned int lock_memory) {
+	lock_memory_ = lock_memory;
+}
+
 void CommonConfigs::set_input_file_name(char *input_file_name) {
 	input_file_name_ = input_file_name;
 }
@@ -21,6 +21,27 @@ class CommonConfigs {
 		unsigned int threads_per_block_;
 		unsigned int groups_;
 		unsigned int packets_;
+		unsigned int segment_mode_;//0 - packets are independent; 1 - each packet rescans the last overlap_bytes_ of the previous one; 2 - each packet starts from the final state of the previous one; 3 - same result, packets scanned in parallel from predicted states (CPU engine)
+		unsigned int overlap_bytes_;//-S 1: bytes shared by consecutive packets; -S 3: bytes of the previous packet used to predict the start state
+		unsigned int cpu_threads_;//CPU engine: number of worker threads (0 - one per hardware thread)
+		unsigned int interleave_;//CPU engine: number of (packet, DFA) streams advanced in lockstep by each thread
+		unsigned int alphabet_reduction_;//CPU engine: 1 - merge equivalent input symbols so that state table rows are narrower than CSIZE
+		unsigned int state_width_reduction_;//CPU engine: 1 - store each state table with 8-bit or 16-bit entries when its states fit
+		unsigned int row_offsets_;//CPU engine: 0 - state ids; 1 - pre-multiplied row offsets unless they need wider entries; 2 - always row offsets
+		unsigned int accel_escapes_;//CPU engine: self-loop states left by at most this many input symbols are skipped over with a byte search (0 - none)
+		unsigned int literal_prefilter_;//CPU engine: a DFA group only scans the packets holding a required literal of its rules, if they all have one of at least this many bytes (0 - no prefilter)
+		unsigned int max_matches_;//matches kept per (packet, DFA) pair, the others are counted as dropped (0 - no limit)
+		unsigned int report_format_;//0 - text reports; 1 - binary reports (see report_writer.h)
+		unsigned int merge_reports_;//0 - one report per DFA group; 1 - one report with the matches of all groups in offset order
+		unsigned int max_flows_;//CPU engine, capture input: TCP streams are reassembled and scanned through a table of up to this many flows (0 - payloads are independent packets)
+		unsigned int flow_timeout_;//CPU engine: seconds of capture time after which an idle flow is dropped
+		unsigned int batch_packets_;//packets scanned per batch while the next batch is read and the reports of the previous one are written (0 - one batch)
+		std::vector<unsigned int> cpu_list_;//CPU engine: CPU that scan thread t is pinned to is cpu_list_[t % size] (empty - threads are not pinned)
+		int numa_node_;//CPU engine: NUMA node the state tables are placed on (-1 - wherever they are loaded)
+		unsigned int huge_pages_;//CPU engine: largest pages for the state tables (HOST_PAGES_* of mem_controller.h)
+		unsigned int lock_memory_;//CPU engine: 1 - state tables locked in memory
+		unsigned int numa_replicate_;//CPU engine: 1 - a copy of the state tables on the node of every CPU of cpu_list_
+		unsigned int cpu_kernel_;//CPU engine: 0 - one (packet, DFA) cell per call; 1 - SIMD, one packet against a vector of DFAs; 2 - SIMD, one DFA against a vector of packets
 		char *input_file_name_;
 			
 		MemController ctl_;
@@ -32,6 +53,27 @@ class CommonConfigs {
 		unsigned int get_threads_per_block() const;
 		unsigned int get_groups() const;
 		unsigned int get_packets() const;
+		unsigned int get_segment_mode() const;
+		unsigned int get_overlap_bytes() const;
+		unsigned int get_cpu_threads() const;
+		unsigned int get_interleave() const;
+		unsigned int get_cpu_kernel() const;
+		unsigned int get_max_matches() const;
+		unsigned int get_report_format() const;
+		unsigned int get_merge_reports() const;
+		unsigned int get_batch_packets() const;
+		unsigned int get_max_flows() const;
+		unsigned int get_flow_timeout() const;
+		unsigned int get_alphabet_reduction() const;
+		unsigned int get_state_width_reduction() const;
+		unsigned int get_row_offsets() const;
+		unsigned int get_accel_escapes() const;
+		unsigned int get_literal_prefilter() const;
+		const std::vector<unsigned int> &get_cpu_list() const;
+		int get_numa_node() const;
+		unsigned int get_numa_replicate() const;
+		unsigned int get_huge_pages() const;
+		unsigned int get_lock_memory() const;
     	const char *get_input_file_name() const;
 		MemController &get_controller();
 		
@@ -39,6 +81,27 @@ class CommonConfigs {
 		void set_threads_per_block(unsigned int threads_per_block);
 		void set_groups(unsigned int ngroups);
 		void set_packets(unsigned int packets);
+		void set_segment_mode(unsigned int segment_mode);
+		void set_overlap_bytes(unsigned int overlap_bytes);
+		void set_cpu_threads(unsigned int cpu_threads);
+		void set_interleave(unsigned int interleave);
+		void set_cpu_kernel(unsigned int cpu_kernel);
+		void set_max_matches(unsigned int max_matches);
+		void set_report_format(unsigned int report_format);
+		void set_merge_reports(unsigned int merge_reports);
+		void set_batch_packets(unsigned int batch_packets);
+		void set_max_flows(unsigned int max_flows);
+		void set_flow_timeout(unsigned int flow_timeout);
+		void set_alphabet_reduction(unsigned int alphabet_reduction);
+		void set_state_width_reduction(unsigned int state_width_reduction);
+		void set_row_offsets(unsigned int row_offsets);
+		void set_accel_escapes(unsigned int accel_escapes);
+		void set_literal_prefilter(unsigned int literal_prefilter);
+		void set_cpu_list(const std::vector<unsigned int> &cpu_list);
+		void set_numa_node(int numa_node);
+		void set_numa_replicate(unsigned int numa_replicate);
+		void set_huge_pages(unsigned int huge_pages);
+		void set_lock_memory(unsigned int lock_memory);
 		void set_input_file_name(char * trace_filename);
 };
 
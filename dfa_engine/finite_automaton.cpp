@@ -8,6 +8,7 @@
 #include <boost/foreach.hpp>
 #include <boost/iterator.hpp>
 #include <cstdlib>
+#include <stdint.h>
 #include <cassert>
 #include <fstream>
 #include <iostream>
@@ -18,8 +19,11 @@
 #include "common_configs.h"
 #include "mem_controller.h"
 #include "finite_automaton.h"
+#include "packets.h"
+#include "report_writer.h"
 
 #include <algorithm>//for "find" function
+#include <functional>//for "greater"
 
 /*------------MNRL------------*/
 #include <unordered_map>
@@ -33,9 +37,28 @@ using namespace MNRL;//MNRL
 
 extern CommonConfigs cfg;
 
+//name of the state table of group gid in the MemController report
+static string table_name(unsigned int gid)
+{
+    ostringstream name;
+    name << "DFA " << (gid + 1) << " state table";
+    return name.str();
+}
 /*------------------------------------------------------------------------------------*/
 FiniteAutomaton::FiniteAutomaton(istream &file1, istream &file2, const char *pattern_name, MemController &allocator, unsigned int gid, int automata_format)
 {
+    alphabet_size_ = CSIZE;
+    for (unsigned int c = 0; c < CSIZE; c++)
+        alphabet_tx_[c] = c;
+    state_width_ = sizeof(state_t);
+    state_table_ = NULL;
+    row_stride_    = CSIZE;
+    accept_offset_ = 0;
+    first_accept_  = 0;
+    rule_scale_    = 1;
+    dead_state_    = -1;
+    std::vector<std::pair<unsigned int, unsigned int> > accept_rules;//(state, rule) pairs, turned into rule_offsets_/rules_
+
     if (automata_format == 1) {//MNRL file
         cout << "DFA filename " << gid + 1 << ": "<< string(pattern_name)+"_dfa.mnrl" << endl;
         shared_ptr<MNRL::MNRLNetwork> mnrl_graph = MNRL::loadMNRL(string(pattern_name) + "_dfa.mnrl");//load MNRL network from mnrl file
@@ -210,7 +233,7 @@ FiniteAutomaton::FiniteAutomaton(istream &file1, istream &file2, const char *pat
 
         // Allocate the DFA data structure in host memory and fill it
         dfa_state_table_size_ = cfg.get_state_count(gid) * CSIZE * sizeof(*dfa_state_table_);
-        dfa_state_table_  = allocator.alloc_host<state_t>(dfa_state_table_size_);
+        dfa_state_table_  = allocator.alloc_host<state_t>(dfa_state_table_size_, table_name(gid).c_str());
         for (unsigned int i=0; i < state_counter; i++)
             memcpy(&dfa_state_table_[i*CSIZE], state_table_map[i], CSIZE * sizeof(*dfa_state_table_));
 
@@ -221,7 +244,7 @@ FiniteAutomaton::FiniteAutomaton(istream &file1, istream &file2, const char *pat
               
         for (unsigned int i=0; i < state_counter; i++) {
             if (accepting_codes_map[i]!=0){
-                states2rules_[i].insert(accepting_codes_map[i]);//insert a new value of rule to the set of this state
+                accept_rules.push_back(std::make_pair(i, accepting_codes_map[i]));//register a new rule of this state
                 accepting_states_[i] = 1;
             }
         }
@@ -252,14 +275,14 @@ FiniteAutomaton::FiniteAutomaton(istream &file1, istream &file2, const char *pat
             file1.read ((char *)&tmp_st,  1 * sizeof(unsigned int));//cout << "file1.eof()=" << file1.eof() << endl;
             if (file1.eof()) break;//Check EOF
             file1.read ((char *)&tmp_rule, 1 * sizeof(unsigned int));
-            states2rules_[tmp_st].insert(tmp_rule);//insert a new value of rule to the set of this state
+            accept_rules.push_back(std::make_pair(tmp_st, tmp_rule));//register a new rule of this state
             //cout << "ACCE_states_ " << tmp_st << ", Rule: " << tmp_rule << endl;
             accepting_states_[tmp_st] = 1;
         }
 
         // Allocate the DFA data structure in host memory and fill it
         dfa_state_table_size_ = cfg.get_state_count(gid) * CSIZE * sizeof(*dfa_state_table_);
-        dfa_state_table_  = allocator.alloc_host<state_t>(dfa_state_table_size_);
+        dfa_state_table_  = allocator.alloc_host<state_t>(dfa_state_table_size_, table_name(gid).c_str());
         file2.read((char *)dfa_state_table_, cfg.get_state_count(gid) * CSIZE * sizeof(state_t));
 
         //Represent accepting states in the DFA state table as negative numbers 
@@ -271,28 +294,498 @@ FiniteAutomaton::FiniteAutomaton(istream &file1, istream &file2, const char *pat
         free(accepting_states_);
     }
 
+    accepting_states_last(allocator, gid, accept_rules);
+
+#ifdef CPU_ONLY
+    if (cfg.get_alphabet_reduction())
+        alphabet_reduction(allocator, gid);
+#endif
+    state_table_ = dfa_state_table_;
+#ifdef CPU_ONLY
+    row_offsets(allocator, gid);
+    if (cfg.get_accel_escapes())
+        accel_states(gid);
+    if (cfg.get_state_width_reduction())
+        state_width_reduction(allocator, gid);
+    if (cfg.get_literal_prefilter())
+        required_literals(pattern_name, gid);
+    if (cfg.get_numa_node() >= 0 || cfg.get_numa_replicate())
+        numa_placement(allocator, gid);
+#endif
+
     //cout << "DFA loading done.\n";
     return;
 }
 /*------------------------------------------------------------------------------------*/
-void FiniteAutomaton::mapping_states2rules(unsigned int *match_count, match_type *match_array, unsigned int match_vec_size, std::vector<unsigned int> pkt_size_vec, std::vector<unsigned int> pad_size_vec, std::ofstream &fp, int *rulestartvec, unsigned int gid) const {//version 2: multi-byte fetching
-    unsigned int total_matches=0;	
-    for (int j = 0; j < pkt_size_vec.size(); j++)	total_matches += match_count[j];
-    fp   << "REPORTS: Total matches: " << total_matches << endl;
+//Renumber the states so that the accepting ones (the targets of negative entries) come last, from
+//first_accept_ on, and store their rules in CSR form: the rules of accepting state first_accept_ + d are
+//rules_[rule_offsets_[d]] .. rules_[rule_offsets_[d+1]-1], sorted. The start state is never the target
+//of a negative entry, so it keeps id 0
+void FiniteAutomaton::accepting_states_last(MemController &allocator, unsigned int gid, std::vector<std::pair<unsigned int, unsigned int> > &accept_rules)
+{
+    unsigned int n_states = cfg.get_state_count(gid);
+    size_t n_entries = (size_t)n_states * CSIZE;
+
+    std::vector<bool> accepting(n_states, false);
+    for (size_t i = 0; i < n_entries; i++)
+        if (dfa_state_table_[i] < 0) accepting[-dfa_state_table_[i]] = true;
+
+    std::vector<unsigned int> new_id(n_states);
+    unsigned int n_rows = 0;
+    for (unsigned int s = 0; s < n_states; s++)
+        if (!accepting[s]) new_id[s] = n_rows++;
+    first_accept_ = n_rows;
+    for (unsigned int s = 0; s < n_states; s++)
+        if (accepting[s]) new_id[s] = n_rows++;
+
+    state_t *renumbered = allocator.alloc_host<state_t>(dfa_state_table_size_, table_name(gid).c_str());
+    for (unsigned int s = 0; s < n_states; s++) {
+        const state_t *row = &dfa_state_table_[(size_t)s * CSIZE];
+        state_t *new_row = &renumbered[(size_t)new_id[s] * CSIZE];
+        for (unsigned int c = 0; c < CSIZE; c++)
+            new_row[c] = row[c] < 0 ? -(state_t)new_id[-row[c]] : (state_t)new_id[row[c]];
+    }
+    allocator.dealloc_host(dfa_state_table_);
+    dfa_state_table_ = renumbered;
+
+    //a dead state is never left and never matches: a scan that reaches it has nothing more to find
+    for (unsigned int s = 0; s < first_accept_ && dead_state_ < 0; s++) {
+        const state_t *row = &dfa_state_table_[(size_t)s * CSIZE];
+        unsigned int c = 0;
+        while (c < CSIZE && row[c] == (state_t)s) c++;
+        if (c == CSIZE) {
+            dead_state_ = s;
+            cout << "DFA "<< (gid + 1) << ": dead state " << s << endl;
+        }
+    }
+
+    //rules of states that are never reached as accepting cannot be reported and are dropped
+    unsigned int n_accept = n_states - first_accept_;
+    rule_offsets_.assign(n_accept + 1, 0);
+    for (size_t k = 0; k < accept_rules.size(); k++)
+        if (accept_rules[k].first < n_states && accepting[accept_rules[k].first])
+            rule_offsets_[new_id[accept_rules[k].first] - first_accept_ + 1]++;
+    for (unsigned int d = 0; d < n_accept; d++)
+        rule_offsets_[d+1] += rule_offsets_[d];
+    rules_.resize(rule_offsets_[n_accept]);
+    std::vector<unsigned int> fill(rule_offsets_.begin(), rule_offsets_.end() - 1);
+    for (size_t k = 0; k < accept_rules.size(); k++)
+        if (accept_rules[k].first < n_states && accepting[accept_rules[k].first])
+            rules_[fill[new_id[accept_rules[k].first] - first_accept_]++] = accept_rules[k].second;
+
+    //same rule listed twice for a state: keep it once, as the set per state used to
+    unsigned int n_rules = 0;
+    for (unsigned int d = 0; d < n_accept; d++) {
+        unsigned int begin = rule_offsets_[d];
+        std::sort(rules_.begin() + begin, rules_.begin() + rule_offsets_[d+1]);
+        rule_offsets_[d] = n_rules;
+        for (unsigned int k = begin; k < rule_offsets_[d+1]; k++)
+            if (k == begin || rules_[k] != rules_[k-1])
+                rules_[n_rules++] = rules_[k];
+    }
+    rule_offsets_[n_accept] = n_rules;
+    rules_.resize(n_rules);
+}
+/*------------------------------------------------------------------------------------*/
+//Merge the input symbols whose columns are identical in every state into one class and keep
+//a single column per class: rows shrink from CSIZE to alphabet_size_ entries, and the scan
+//looks up dfa_state_table_[state * alphabet_size_ + alphabet_tx_[symbol]] instead
+void FiniteAutomaton::alphabet_reduction(MemController &allocator, unsigned int gid)
+{
+    unsigned int n_states = cfg.get_state_count(gid);
+
+    //hash every column once, then compare columns only when their hashes are equal
+    std::vector<unsigned long long> col_hash(CSIZE, 1469598103934665603ULL);
+    for (unsigned int s = 0; s < n_states; s++) {
+        const state_t *row = &dfa_state_table_[(size_t)s * CSIZE];
+        for (unsigned int c = 0; c < CSIZE; c++)
+            col_hash[c] = (col_hash[c] ^ (unsigned int)row[c]) * 1099511628211ULL;
+    }
 
-    for (int j = 0; j < pkt_size_vec.size(); j++) {
+    std::vector<unsigned int> class_rep;//first input symbol of each class
+    for (unsigned int c = 0; c < CSIZE; c++) {
+        unsigned int k;
+        for (k = 0; k < class_rep.size(); k++) {
+            unsigned int r = class_rep[k];
+            if (col_hash[r] != col_hash[c]) continue;
+            unsigned int s;
+            for (s = 0; s < n_states; s++)
+                if (dfa_state_table_[(size_t)s * CSIZE + r] != dfa_state_table_[(size_t)s * CSIZE + c]) break;
+            if (s == n_states) break;
+        }
+        if (k == class_rep.size())
+            class_rep.push_back(c);
+        alphabet_tx_[c] = k;
+    }
+
+    if (class_rep.size() == CSIZE)
+        return;
+
+    alphabet_size_ = class_rep.size();
+    size_t reduced_size = (size_t)n_states * alphabet_size_ * sizeof(*dfa_state_table_);
+    state_t *reduced = allocator.alloc_host<state_t>(reduced_size, table_name(gid).c_str());
+    for (unsigned int s = 0; s < n_states; s++)
+        for (unsigned int k = 0; k < alphabet_size_; k++)
+            reduced[(size_t)s * alphabet_size_ + k] = dfa_state_table_[(size_t)s * CSIZE + class_rep[k]];
+
+    cout << "DFA "<< (gid + 1) << ": alphabet reduced to " << alphabet_size_ << " symbol classes, state table "
+         << dfa_state_table_size_/1024.0/1024.0 << " MB -> " << reduced_size/1024.0/1024.0 << " MB" << endl;
+
+    allocator.dealloc_host(dfa_state_table_);
+    dfa_state_table_      = reduced;
+    dfa_state_table_size_ = reduced_size;
+}
+/*------------------------------------------------------------------------------------*/
+//bytes per entry needed to hold every value up to max_entry (with -W 0 entries are always 32-bit)
+static unsigned int entry_width(size_t max_entry)
+{
+    if (!cfg.get_state_width_reduction()) return sizeof(state_t);
+    if (max_entry <= 0xFF)                 return sizeof(uint8_t);
+    if (max_entry <= 0xFFFF)               return sizeof(uint16_t);
+    return sizeof(state_t);
+}
+/*------------------------------------------------------------------------------------*/
+//Re-encode the table for the CPU kernels. The accepting states already come last (accepting_states_last),
+//so accepting status becomes entry >= accept_offset_ instead of the sign bit (as with the negative
+//encoding, a match on the start state is never reported). Entries are then either pre-multiplied row
+//offsets, so that a step is table[entry + column] (row_stride_ = 1), or plain state ids
+//(row_stride_ = alphabet_size_) when the offsets would need wider entries than the ids
+void FiniteAutomaton::row_offsets(MemController &allocator, unsigned int gid)
+{
+    unsigned int n_states = cfg.get_state_count(gid);
+    size_t n_entries = (size_t)n_states * alphabet_size_;
+
+    bool premultiplied;
+    switch (cfg.get_row_offsets()) {
+        case 0:  premultiplied = false; break;
+        case 2:  premultiplied = true;  break;
+        default: premultiplied = entry_width(n_entries - alphabet_size_) <= entry_width(n_states - 1); break;
+    }
+    if (premultiplied && n_entries > 0x7FFFFFFF) {
+        cout << "DFA "<< (gid + 1) << ": state table too large for 32-bit row offsets, keeping state ids" << endl;
+        premultiplied = false;
+    }
+    unsigned int row_scale = premultiplied ? alphabet_size_ : 1;//entry value of row r: r * row_scale
+    row_stride_    = premultiplied ? 1 : alphabet_size_;
+    accept_offset_ = first_accept_ * row_scale;
+    rule_scale_    = row_scale;
+
+    for (size_t i = 0; i < n_entries; i++)
+        dfa_state_table_[i] = (dfa_state_table_[i] < 0 ? -dfa_state_table_[i] : dfa_state_table_[i]) * row_scale;
+
+    if (premultiplied)
+        cout << "DFA "<< (gid + 1) << ": pre-multiplied row offsets" << endl;
+}
+/*------------------------------------------------------------------------------------*/
+//Find the states worth skipping over: non-accepting states that every input symbol but a few (the escapes,
+//at most cfg.get_accel_escapes() of them) leads back to. While the CPU kernels sit in one, they search the
+//input for the next escape instead of stepping byte by byte. The dead state has no escapes and is left out
+void FiniteAutomaton::accel_states(unsigned int gid)
+{
+    unsigned int n_states = cfg.get_state_count(gid);
+    accel_index_.assign(n_states, 0);
+
+    for (unsigned int s = 0; s < first_accept_; s++) {
+        if ((int)s == dead_state_)
+            continue;
+        const state_t *row = &dfa_state_table_[(size_t)s * alphabet_size_];
+        state_t self = (state_t)(s * rule_scale_);
+        accel_type a;
+        a.n_escapes = 0;
+        unsigned int c;
+        for (c = 0; c < CSIZE; c++) {
+            if (row[alphabet_tx_[c]] == self)
+                continue;
+            if (a.n_escapes == cfg.get_accel_escapes())
+                break;
+            a.escapes[a.n_escapes++] = c;
+        }
+        if (c < CSIZE || a.n_escapes == 0)
+            continue;
+
+        //shufti masks: one bucket bit per set of low nibbles, shared by the high nibbles that escape on that set;
+        //past 8 sets, buckets are shared and the search stops at a few symbols that are not escapes (the step from there stays in s)
+        unsigned int low_sets[16] = {0};//high nibble -> low nibbles of the escapes
+        for (unsigned int e = 0; e < a.n_escapes; e++)
+            low_sets[a.escapes[e] >> 4] |= 1u << (a.escapes[e] & 15);
+        unsigned int buckets[8], n_buckets = 0;
+        memset(a.lo, 0, sizeof(a.lo));
+        memset(a.hi, 0, sizeof(a.hi));
+        for (unsigned int h = 0; h < 16; h++) {
+            if (low_sets[h] == 0)
+                continue;
+            unsigned int b = 0;
+            while (b < n_buckets && buckets[b] != low_sets[h])
+                b++;
+            if (b == n_buckets) {
+                if (n_buckets < 8)
+                    buckets[n_buckets++] = low_sets[h];
+                else
+                    b = h % 8;
+            }
+            a.hi[h] |= 1 << b;
+            for (unsigned int l = 0; l < 16; l++)
+                if (low_sets[h] & (1u << l))
+                    a.lo[l] |= 1 << b;
+        }
+
+        accel_.push_back(a);
+        accel_index_[s] = accel_.size();
+    }
+
+    if (accel_.empty())
+        accel_index_.clear();
+    else
+        cout << "DFA "<< (gid + 1) << ": accelerated states: " << accel_.size()
+             << (accel_index_[0] ? " (start state included)" : "") << endl;
+}
+/*------------------------------------------------------------------------------------*/
+//Store the table with the narrowest entries that hold the largest one (a row offset or a state id),
+//8-bit or 16-bit. state_table_ then points to the narrow copy and the 32-bit table is released
+void FiniteAutomaton::state_width_reduction(MemController &allocator, unsigned int gid)
+{
+    size_t n_entries = dfa_state_table_size_ / sizeof(state_t);
+    size_t max_entry = (size_t)(cfg.get_state_count(gid) - 1) * (row_stride_ == 1 ? alphabet_size_ : 1);
+
+    state_width_ = entry_width(max_entry);
+    if (state_width_ == sizeof(state_t))
+        return;
+
+    //the SIMD kernels load 32-bit words at the address of an entry: keep sizeof(state_t) readable bytes past the last one
+    size_t narrow_size = n_entries * state_width_;
+    char *narrow = allocator.alloc_host<char>(narrow_size + sizeof(state_t), table_name(gid).c_str());
+    memset(narrow + narrow_size, 0, sizeof(state_t));
+    if (state_width_ == sizeof(uint8_t)) {
+        for (size_t i = 0; i < n_entries; i++)
+            ((uint8_t *)narrow)[i] = (uint8_t)dfa_state_table_[i];
+    }
+    else {
+        for (size_t i = 0; i < n_entries; i++)
+            ((uint16_t *)narrow)[i] = (uint16_t)dfa_state_table_[i];
+    }
+
+    cout << "DFA "<< (gid + 1) << ": " << state_width_*8 << "-bit entries, state table "
+         << dfa_state_table_size_/1024.0/1024.0 << " MB -> " << narrow_size/1024.0/1024.0 << " MB" << endl;
+
+    allocator.dealloc_host(dfa_state_table_);
+    dfa_state_table_      = NULL;
+    state_table_          = narrow;
+    dfa_state_table_size_ = narrow_size;
+}
+/*------------------------------------------------------------------------------------*/
+//Required literals of the rules, from <pattern_name>_lit.bin when the regex compiler wrote one: per rule, its id,
+//flags (1 - case-insensitive), length (0 - none) and the literal, a string that every match of the rule contains.
+//A packet that holds none of them cannot match in this group, so the CPU engine does not scan it; this only
+//holds if every rule of the group has a literal, of at least cfg.get_literal_prefilter() bytes to be worth a search
+void FiniteAutomaton::required_literals(const char *pattern_name, unsigned int gid)
+{
+    ifstream file((string(pattern_name) + "_lit.bin").c_str(), ios::binary | ios::in);
+    if (!file.good()) {
+        cout << "DFA "<< (gid + 1) << ": no literal prefilter, no " << pattern_name << "_lit.bin (written by regex_memory only)" << endl;
+        return;
+    }
+
+    map<unsigned int, pair<string, bool> > rule_literals;
+    unsigned int record[3];//rule, flags, length
+    while (file.read((char *)record, sizeof(record))) {
+        string literal(record[2], '\0');
+        if (record[2] > 0 && !file.read(&literal[0], record[2]))
+            break;
+        rule_literals[record[0]] = make_pair(literal, (record[1] & 1) != 0);
+    }
+
+    set<unsigned int> rules(rules_.begin(), rules_.end());
+    for (set<unsigned int>::const_iterator r = rules.begin(); r != rules.end(); ++r) {
+        map<unsigned int, pair<string, bool> >::const_iterator l = rule_literals.find(*r);
+        if (l == rule_literals.end() || l->second.first.size() < cfg.get_literal_prefilter()) {
+            cout << "DFA "<< (gid + 1) << ": no literal prefilter, rule " << *r << " has no required literal of "
+                 << cfg.get_literal_prefilter() << " bytes or more" << endl;
+            literals_.clear();
+            return;
+        }
+        literals_.push_back(l->second);
+    }
+    if (!literals_.empty())
+        cout << "DFA "<< (gid + 1) << ": literal prefilter, " << literals_.size() << " required literals" << endl;
+}
+/*------------------------------------------------------------------------------------*/
+//Move the table scanned by the CPU engine to the NUMA node of -n, and with -r 1 copy it to the node of every CPU of -P,
+//so that each pinned thread reads its transitions from the memory of its own socket
+void FiniteAutomaton::numa_placement(MemController &allocator, unsigned int gid)
+{
+    //narrow tables end with sizeof(state_t) spare bytes (see state_width_reduction)
+    size_t table_bytes = dfa_state_table_size_ + (state_width_ != sizeof(state_t) ? sizeof(state_t) : 0);
+    int home = cfg.get_numa_node();
+
+    if (home >= 0) {
+        char *placed = allocator.alloc_host_on_node<char>(table_bytes, home, table_name(gid).c_str());
+        if (placed) {
+            memcpy(placed, state_table_, table_bytes);
+            allocator.dealloc_host(state_table_);
+            if (dfa_state_table_ == state_table_)
+                dfa_state_table_ = (state_t *)placed;
+            state_table_ = placed;
+        }
+    }
+
+    if (cfg.get_numa_replicate()) {
+        const vector<unsigned int> &cpus = cfg.get_cpu_list();
+        node_tables_.assign(MemController::numa_nodes(), (const void *)NULL);
+        for (unsigned int c = 0; c < cpus.size(); c++) {
+            int node = MemController::numa_node_of_cpu(cpus[c]);
+            if (node < 0 || node >= (int)node_tables_.size() || node_tables_[node])
+                continue;
+            if (node == home) {
+                node_tables_[node] = state_table_;
+                continue;
+            }
+            char *copy = allocator.alloc_host_on_node<char>(table_bytes, node, (table_name(gid) + " copy").c_str());
+            if (copy) {
+                memcpy(copy, state_table_, table_bytes);
+                node_tables_[node] = copy;
+            }
+        }
+    }
+
+    cout << "DFA "<< (gid + 1) << ": state table";
+    if (home >= 0)
+        cout << " on NUMA node " << home;
+    if (cfg.get_numa_replicate()) {
+        cout << " copied to NUMA node(s)";
+        for (unsigned int n = 0; n < node_tables_.size(); n++)
+            if (node_tables_[n])
+                cout << " " << n;
+    }
+    cout << endl;
+}
+/*------------------------------------------------------------------------------------*/
+unsigned int FiniteAutomaton::mapping_states2rules(const unsigned int *match_count, const match_type *const *match_arrays, Packets &packets, std::string &report, unsigned int report_format, int *rulestartvec, unsigned int gid) const {//version 2: multi-byte fetching
+    const vector<unsigned int> &data_size_vec     = packets.get_data_sizes();
+    const vector<size_t>       &stream_offset_vec = packets.get_stream_offsets();
+    const vector<unsigned int> &overlap_size_vec  = packets.get_overlap_sizes();
+
+    //matches in the overlap of a packet are reported by the previous packet, matches in the padding are not in the input
+    unsigned int total_matches=0;
+    unsigned long long total_records=0;
+    for (int j = 0; j < data_size_vec.size(); j++)
+        for (unsigned i = 0; i < match_count[j]; i++)
+            if (match_arrays[j][i].off >= overlap_size_vec[j] && match_arrays[j][i].off < data_size_vec[j]) {
+                total_matches++;
+                unsigned int n_rules;
+                get_rules(match_arrays[j][i].stat, &n_rules);
+                total_records += n_rules ? n_rules : 1;
+            }
+
+    //reports are built in memory and written in one go: text lines are short, and flushing each one costs more than the scan
+    char line[64];
+    if (report_format == 1)
+        report_append_header(report, gid + 1, total_matches, total_records);
+    else
+        report.append(line, snprintf(line, sizeof(line), "REPORTS: Total matches: %u\n", total_matches));
+
+    for (int j = 0; j < data_size_vec.size(); j++) {
         for (unsigned i = 0; i < match_count[j]; i++) {
-            map<unsigned, set<unsigned> >::const_iterator it = states2rules_.find(match_array[match_vec_size*j + i].stat);		
-            if (j==0) fp   << match_array[match_vec_size*j + i].off  << "::" << endl;
-            else      fp   << match_array[match_vec_size*j + i].off + j * pkt_size_vec[0] - (pad_size_vec.empty() ? 0 : pad_size_vec[j-1]) << "::" << endl;
-            if (it != states2rules_.end()) {
-                set<unsigned>::iterator iitt;
-                for (iitt = it->second.begin();	iitt != it->second.end(); ++iitt) {
-                    fp   << "    Rule: " << *iitt + rulestartvec[gid] << endl;
-                }
+            if (match_arrays[j][i].off < overlap_size_vec[j] || match_arrays[j][i].off >= data_size_vec[j])
+                continue;
+            unsigned int n_rules;
+            const unsigned int *rules = get_rules(match_arrays[j][i].stat, &n_rules);
+            if (report_format == 1) {
+                uint64_t off = (uint64_t)match_arrays[j][i].off + stream_offset_vec[j];
+                if (n_rules == 0)
+                    report_append_record(report, off, REPORT_NO_RULE);
+                for (unsigned int r = 0; r < n_rules; r++)
+                    report_append_record(report, off, rules[r] + rulestartvec[gid]);
+                continue;
+            }
+            report.append(line, snprintf(line, sizeof(line), "%llu::\n", (unsigned long long)match_arrays[j][i].off + stream_offset_vec[j]));
+            for (unsigned int r = 0; r < n_rules; r++)
+                report.append(line, snprintf(line, sizeof(line), "    Rule: %u\n", rules[r] + rulestartvec[gid]));
+        }
+    }
+    return total_matches;
+}
+/*------------------------------------------------------------------------------------*/
+//next reported match of one group in the k-way merge of merge_states2rules
+struct merge_cursor {
+    uint64_t off;//offset in the input file
+    unsigned int gid;
+    unsigned int pkt;
+    unsigned int idx;
+    bool operator>(const merge_cursor &other) const {
+        return off > other.off || (off == other.off && gid > other.gid);
+    }
+};
+
+//moves the cursor to the first reported match of its group from (pkt, idx) on; false when the group has no more
+static bool merge_cursor_seek(merge_cursor &c, const unsigned int *match_count, const match_type *const *match_arrays, Packets &packets) {
+    const vector<unsigned int> &data_size_vec = packets.get_data_sizes();
+    unsigned int n_packets = data_size_vec.size();
+    for (; c.pkt < n_packets; c.pkt++, c.idx = 0) {
+        unsigned int cell = c.pkt + c.gid * n_packets;
+        for (; c.idx < match_count[cell]; c.idx++) {
+            const match_type &m = match_arrays[cell][c.idx];
+            if (m.off >= packets.get_overlap_sizes()[c.pkt] && m.off < data_size_vec[c.pkt]) {
+                c.off = (uint64_t)m.off + packets.get_stream_offsets()[c.pkt];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+unsigned int merge_states2rules(const std::vector<FiniteAutomaton *> &fa, const unsigned int *match_count, const match_type *const *match_arrays, Packets &packets, std::string &report, unsigned int report_format, int *rulestartvec) {
+    //the reported matches of each group are already in offset order (packets follow each other in the input and the
+    //matches of a packet are found in order), so a k-way merge over the groups sorts all of them
+    std::priority_queue<merge_cursor, std::vector<merge_cursor>, std::greater<merge_cursor> > heap;
+    for (unsigned int g = 0; g < fa.size(); g++) {
+        merge_cursor c;
+        c.gid = g; c.pkt = 0; c.idx = 0;
+        if (merge_cursor_seek(c, match_count, match_arrays, packets))
+            heap.push(c);
+    }
+
+    //matches of several groups at the same offset become one entry with the rules of all of them, in group order
+    std::string body;
+    char line[64];
+    unsigned int total_matches=0, total_entries=0;
+    unsigned long long total_records=0;
+    unsigned int n_packets = packets.get_data_sizes().size();
+    while (!heap.empty()) {
+        uint64_t off = heap.top().off;
+        unsigned int n_rules = 0;
+        if (report_format != 1)
+            body.append(line, snprintf(line, sizeof(line), "%llu::\n", (unsigned long long)off));
+        while (!heap.empty() && heap.top().off == off) {
+            merge_cursor c = heap.top();
+            heap.pop();
+            unsigned int n_group_rules;
+            const unsigned int *rules = fa[c.gid]->get_rules(match_arrays[c.pkt + c.gid * n_packets][c.idx].stat, &n_group_rules);
+            for (unsigned int r = 0; r < n_group_rules; r++) {
+                if (report_format == 1)
+                    report_append_record(body, off, rules[r] + rulestartvec[c.gid]);
+                else
+                    body.append(line, snprintf(line, sizeof(line), "    Rule: %u\n", rules[r] + rulestartvec[c.gid]));
             }
+            n_rules += n_group_rules;
+            total_matches++;
+            c.idx++;
+            if (merge_cursor_seek(c, match_count, match_arrays, packets))
+                heap.push(c);
+        }
+        if (report_format == 1 && n_rules == 0) {
+            report_append_record(body, off, REPORT_NO_RULE);
+            n_rules = 1;
         }
+        total_records += n_rules;
+        total_entries++;
     }
+
+    if (report_format == 1)
+        report_append_header(report, 0, total_entries, total_records);
+    else
+        report.append(line, snprintf(line, sizeof(line), "REPORTS: Total matches: %u\n", total_entries));
+    report.append(body);
+    return total_matches;
 }
 /*------------------------------------------------------------------------------------*/
 FiniteAutomaton *load_dfa_file(const char *pattern_name, unsigned int gid, int automata_format) {
@@ -337,7 +830,7 @@ FiniteAutomaton *load_dfa_file(const char *pattern_name, unsigned int gid, int a
 
         FiniteAutomaton *fa = new FiniteAutomaton(file1, file2, pattern_name, cfg.get_controller(), gid, automata_format);
 
-        if (automata_format == 0) {
+        if (automata_format != 1) {
             file1.close();
             file2.close();
         }
@@ -357,3 +850,59 @@ state_t *FiniteAutomaton::get_dfa_state_table() {
 size_t FiniteAutomaton::get_dfa_state_table_size() const {
     return dfa_state_table_size_;
 }
+/*------------------------------------------------------------------------------------*/
+unsigned int FiniteAutomaton::get_alphabet_size() const {
+    return alphabet_size_;
+}
+/*------------------------------------------------------------------------------------*/
+const symbol *FiniteAutomaton::get_alphabet_tx() const {
+    return alphabet_tx_;
+}
+/*------------------------------------------------------------------------------------*/
+const void *FiniteAutomaton::get_state_table(int node) const {
+    if (node >= 0 && node < (int)node_tables_.size() && node_tables_[node])
+        return node_tables_[node];
+    return state_table_;
+}
+
+const void *FiniteAutomaton::get_state_table() const {
+    return state_table_;
+}
+/*------------------------------------------------------------------------------------*/
+unsigned int FiniteAutomaton::get_state_width() const {
+    return state_width_;
+}
+/*------------------------------------------------------------------------------------*/
+unsigned int FiniteAutomaton::get_row_stride() const {
+    return row_stride_;
+}
+/*------------------------------------------------------------------------------------*/
+unsigned int FiniteAutomaton::get_accept_offset() const {
+    return accept_offset_;
+}
+/*------------------------------------------------------------------------------------*/
+state_t FiniteAutomaton::get_dead_state() const {
+    return dead_state_ < 0 ? -1 : dead_state_ * (state_t)rule_scale_;
+}
+/*------------------------------------------------------------------------------------*/
+const accel_type *FiniteAutomaton::get_accel() const {
+    return accel_.empty() ? NULL : &accel_[0];
+}
+/*------------------------------------------------------------------------------------*/
+const unsigned int *FiniteAutomaton::get_accel_index() const {
+    return accel_index_.empty() ? NULL : &accel_index_[0];
+}
+/*------------------------------------------------------------------------------------*/
+const std::vector<std::pair<std::string, bool> > &FiniteAutomaton::get_literals() const {
+    return literals_;
+}
+/*------------------------------------------------------------------------------------*/
+const unsigned int *FiniteAutomaton::get_rules(unsigned int stat, unsigned int *n_rules) const {
+    unsigned int d = stat / rule_scale_ - first_accept_;//wraps around below first_accept_
+    if (stat % rule_scale_ != 0 || d >= rule_offsets_.size() - 1) {
+        *n_rules = 0;
+        return NULL;
+    }
+    *n_rules = rule_offsets_[d+1] - rule_offsets_[d];
+    return &rules_[0] + rule_offsets_[d];
+}
@@ -11,23 +11,64 @@
 #include <fstream>
 #include <map>
 #include <set>
+#include <string>
 #include <vector>
 #include <stdio.h>
 #include "common.h"
 
+class Packets;
+
 class FiniteAutomaton {
     private:
         size_t dfa_state_table_size_;
         state_t *dfa_state_table_;
-        std::map<unsigned int, std::set<unsigned int> > states2rules_;
+        std::vector<unsigned int> rule_offsets_;//CSR: rules of the d-th accepting state are rules_[rule_offsets_[d]] .. rules_[rule_offsets_[d+1]-1]
+        std::vector<unsigned int> rules_;
+        unsigned int first_accept_;//accepting states are renumbered last: ids from first_accept_ on
+        unsigned int rule_scale_;//match state (.stat) of accepting state id s: s * rule_scale_ (the CPU row offsets)
+        int dead_state_;//non-accepting state whose transitions all lead to itself, -1 if none
+        unsigned int alphabet_size_;//number of columns of each row of dfa_state_table_
+        symbol alphabet_tx_[CSIZE];//input symbol -> column (identity unless the alphabet is reduced)
+        unsigned int state_width_;//bytes per entry of state_table_: 1, 2 or 4
+        void *state_table_;//table scanned by the CPU engine: dfa_state_table_ itself, or a copy with narrower entries
+        unsigned int row_stride_;//CPU engine: entry of the next state = state_table_[entry * row_stride_ + column]; 1 when entries are row offsets
+        unsigned int accept_offset_;//CPU engine: entries >= accept_offset_ lead to accepting states
+        std::vector<accel_type> accel_;//CPU engine: accelerated states
+        std::vector<unsigned int> accel_index_;//CPU engine: per state id, 1 + index of its entry in accel_ (0 - not accelerated)
+        std::vector<const void *> node_tables_;//CPU engine: copy of state_table_ on each NUMA node (NULL - none, the threads of the node read state_table_)
+        std::vector<std::pair<std::string, bool> > literals_;//CPU engine: one required literal (case-insensitive or not) per rule of the group, empty if some rule has none
+
+        void accepting_states_last(MemController &, unsigned int, std::vector<std::pair<unsigned int, unsigned int> > &);
+        void alphabet_reduction(MemController &, unsigned int);
+        void row_offsets(MemController &, unsigned int);
+        void state_width_reduction(MemController &, unsigned int);
+        void accel_states(unsigned int);
+        void required_literals(const char *, unsigned int);
+        void numa_placement(MemController &, unsigned int);
 
     public:
         FiniteAutomaton(std::istream &, std::istream &, const char *, MemController &, unsigned int, int);
-        void mapping_states2rules(unsigned int *match_count, match_type *match_array, unsigned int match_vec_size, std::vector<unsigned int> pkt_size_vec, std::vector<unsigned int> pad_size_vec, std::ofstream &fp, int *rulestartvec, unsigned int gid) const;//version 2: multi-byte fetching
+        unsigned int mapping_states2rules(const unsigned int *match_count, const match_type *const *match_arrays, Packets &packets, std::string &report, unsigned int report_format, int *rulestartvec, unsigned int gid) const;//version 2: multi-byte fetching; match_arrays[j] holds the match_count[j] matches of packet j; appends the report (0 - text, 1 - binary) of group gid; returns the number of reported matches
         state_t *get_dfa_state_table();
         size_t get_dfa_state_table_size() const;
+        unsigned int get_alphabet_size() const;
+        const symbol *get_alphabet_tx() const;
+        const void *get_state_table() const;
+        const void *get_state_table(int node) const;//copy on NUMA node node if there is one (-r 1), state_table_ otherwise
+        unsigned int get_state_width() const;
+        unsigned int get_row_stride() const;
+        unsigned int get_accept_offset() const;
+        state_t get_dead_state() const;//entry (CPU engine) or state id (GPU engine) of the dead state, -1 if none
+        const accel_type *get_accel() const;//accelerated states, NULL if none
+        const unsigned int *get_accel_index() const;//per state id: 1 + index in get_accel(), 0 if not accelerated; NULL if none
+        const std::vector<std::pair<std::string, bool> > &get_literals() const;//required literals of the rules (see required_literals), empty if none
+        const unsigned int *get_rules(unsigned int stat, unsigned int *n_rules) const;//rules (group-local ids, sorted) of the state of a match, *n_rules of them (0 - none)
 };
 
 FiniteAutomaton *load_dfa_file(const char *pattern_name, unsigned int gid, int automata_format);
 
+//one report for all the groups: the matches of group g are match_arrays[j + g*n_packets] (match_count[j + g*n_packets] of them) for each packet j;
+//they are merged in offset order, matches of several groups at the same offset making one entry. Returns the number of (group) matches merged
+unsigned int merge_states2rules(const std::vector<FiniteAutomaton *> &fa, const unsigned int *match_count, const match_type *const *match_arrays, Packets &packets, std::string &report, unsigned int report_format, int *rulestartvec);
+
 #endif
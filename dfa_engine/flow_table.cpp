@@ -0,0 +1,236 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * flow_table.cpp
+ */
+
+#include "flow_table.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+#define FLOW_NONE 0xFFFFFFFF //end of the LRU list
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+
+size_t flow_key_hash::operator()(const flow_key &key) const {
+	//FNV-1a
+	const unsigned char *bytes = (const unsigned char *)&key;
+	uint64_t h = 14695981039346656037ULL;
+	for (unsigned int b = 0; b < sizeof(flow_key); b++) {
+		h ^= bytes[b];
+		h *= 1099511628211ULL;
+	}
+	return (size_t)h;
+}
+
+bool flow_key_equal::operator()(const flow_key &a, const flow_key &b) const {
+	return memcmp(&a, &b, sizeof(flow_key)) == 0;
+}
+
+FlowTable::FlowTable(const udfa_flow_engine *engine, unsigned int max_flows, unsigned int idle_timeout) :
+	engine_(engine), max_flows_(max_flows), idle_timeout_((uint64_t)idle_timeout * 1000000), state_size_(udfa_flow_state_size(engine)),
+	lru_head_(FLOW_NONE), lru_tail_(FLOW_NONE),
+	created_(0), closed_(0), evicted_idle_(0), evicted_full_(0),
+	reordered_(0), retransmitted_bytes_(0), gaps_(0), dropped_pending_(0), max_active_(0) {
+	index_.reserve(max_flows < 65536 ? max_flows : 65536);
+}
+
+void FlowTable::unlink(unsigned int f) {
+	flow &fl = flows_[f];
+	if (fl.prev != FLOW_NONE) flows_[fl.prev].next = fl.next;
+	else                      lru_head_ = fl.next;
+	if (fl.next != FLOW_NONE) flows_[fl.next].prev = fl.prev;
+	else                      lru_tail_ = fl.prev;
+}
+
+void FlowTable::push_front(unsigned int f) {
+	flows_[f].prev = FLOW_NONE;
+	flows_[f].next = lru_head_;
+	if (lru_head_ != FLOW_NONE) flows_[lru_head_].prev = f;
+	else                        lru_tail_ = f;
+	lru_head_ = f;
+}
+
+void FlowTable::release(unsigned int f) {
+	unlink(f);
+	index_.erase(flows_[f].key);
+	dropped_pending_ += flows_[f].n_pending;
+	free_.push_back(f);
+}
+
+unsigned int FlowTable::lookup(const pcap_packet &pkt, bool *created) {
+	flow_key key;
+	memcpy(key.src, pkt.src, sizeof(key.src));
+	memcpy(key.dst, pkt.dst, sizeof(key.dst));
+	key.sport      = pkt.sport;
+	key.dport      = pkt.dport;
+	key.ip_version = pkt.ip_version;
+	key.proto      = pkt.proto;
+
+	unordered_map<flow_key, unsigned int, flow_key_hash, flow_key_equal>::iterator it = index_.find(key);
+	if (it != index_.end()) {
+		*created = false;
+		unlink(it->second);
+		push_front(it->second);
+		return it->second;
+	}
+
+	if (index_.size() >= max_flows_) {//full: the least recently used flow makes room
+		release(lru_tail_);
+		evicted_full_++;
+	}
+	unsigned int f;
+	if (!free_.empty()) {
+		f = free_.back();
+		free_.pop_back();
+	}
+	else {
+		f = flows_.size();
+		flows_.resize(f + 1);
+		states_.resize((size_t)(f + 1) * state_size_);
+	}
+	flow &fl = flows_[f];
+	fl.key       = key;
+	fl.next_seq  = 0;
+	fl.fin       = false;
+	fl.fin_seq   = 0;
+	fl.n_pending = 0;
+	udfa_flow_state_init(engine_, &states_[(size_t)f * state_size_]);
+	index_[key] = f;
+	push_front(f);
+
+	created_++;
+	if (index_.size() > max_active_)
+		max_active_ = index_.size();
+	*created = true;
+	return f;
+}
+
+//scans the bytes of [seq, seq + size) that come next in the flow, or holds them if bytes before them are missing
+void FlowTable::deliver(flow &fl, uint32_t seq, size_t offset, unsigned int size, vector<flow_chunk> &chunks) {
+	int32_t diff = (int32_t)(seq - fl.next_seq);//sequence numbers wrap around
+	if (diff < 0) {//retransmitted, at least in part
+		unsigned int seen = (unsigned int)-diff;
+		if (seen >= size) {
+			retransmitted_bytes_ += size;
+			return;
+		}
+		retransmitted_bytes_ += seen;
+		offset += seen;
+		size   -= seen;
+		diff    = 0;
+	}
+	if (diff == 0) {
+		flow_chunk chunk;
+		chunk.offset = offset;
+		chunk.size   = size;
+		chunks.push_back(chunk);
+		fl.next_seq += size;
+		drain(fl, chunks);
+		return;
+	}
+
+	reordered_++;
+	if (fl.n_pending == CPU_FLOW_MAX_PENDING) {
+		//too many holes: the missing bytes are given up, the flow resumes at the first segment held
+		unsigned int first = 0;
+		for (unsigned int k = 1; k < fl.n_pending; k++)
+			if ((int32_t)(fl.pending[k].seq - fl.pending[first].seq) < 0)
+				first = k;
+		if ((int32_t)(seq - fl.pending[first].seq) < 0)
+			fl.next_seq = seq;
+		else
+			fl.next_seq = fl.pending[first].seq;
+		gaps_++;
+		drain(fl, chunks);
+		deliver(fl, seq, offset, size, chunks);
+		return;
+	}
+	fl.pending[fl.n_pending].seq    = seq;
+	fl.pending[fl.n_pending].size   = size;
+	fl.pending[fl.n_pending].offset = offset;
+	fl.n_pending++;
+}
+
+//scans the held segments that the flow has reached
+void FlowTable::drain(flow &fl, vector<flow_chunk> &chunks) {
+	bool progress = true;
+	while (progress) {
+		progress = false;
+		for (unsigned int k = 0; k < fl.n_pending; k++) {
+			int32_t diff = (int32_t)(fl.pending[k].seq - fl.next_seq);
+			if (diff > 0)
+				continue;
+			uint32_t seq = fl.pending[k].seq;
+			size_t offset = fl.pending[k].offset;
+			unsigned int size = fl.pending[k].size;
+			fl.pending[k] = fl.pending[--fl.n_pending];
+			deliver(fl, seq, offset, size, chunks);
+			progress = true;
+			break;
+		}
+	}
+}
+
+void *FlowTable::add(const pcap_packet &pkt, vector<flow_chunk> &chunks) {
+	chunks.clear();
+	while (lru_tail_ != FLOW_NONE && flows_[lru_tail_].last_seen + idle_timeout_ < pkt.ts_usec) {
+		release(lru_tail_);
+		evicted_idle_++;
+	}
+
+	bool created;
+	unsigned int f = lookup(pkt, &created);
+	flow &fl = flows_[f];
+	fl.last_seen = pkt.ts_usec;
+	void *state = &states_[(size_t)f * state_size_];
+
+	if (pkt.proto != PCAP_PROTO_TCP) {
+		if (pkt.size) {
+			flow_chunk chunk;
+			chunk.offset = pkt.offset;
+			chunk.size   = pkt.size;
+			chunks.push_back(chunk);
+		}
+		return state;
+	}
+
+	uint32_t seq = pkt.seq + ((pkt.tcp_flags & TCP_SYN) ? 1 : 0);//the SYN takes one sequence number
+	if (created)
+		fl.next_seq = seq;//from the SYN, or from the first segment seen if the capture starts mid-connection
+	if (pkt.size)
+		deliver(fl, seq, pkt.offset, pkt.size, chunks);
+
+	if (pkt.tcp_flags & TCP_RST) {
+		release(f);
+		closed_++;
+	}
+	else {
+		//a FIN may arrive ahead of missing bytes: the flow waits for them (or for its eviction)
+		if ((pkt.tcp_flags & TCP_FIN) && !fl.fin) {
+			fl.fin     = true;
+			fl.fin_seq = seq + pkt.size;
+		}
+		if (fl.fin && (int32_t)(fl.next_seq - fl.fin_seq) >= 0) {
+			release(f);
+			closed_++;
+		}
+	}
+	return state;
+}
+
+unsigned int FlowTable::get_active() const {
+	return index_.size();
+}
+
+void FlowTable::print_stats() const {
+	printf("Flows: %llu created, %llu closed, %llu evicted idle, %llu evicted from the full table, at most %u at a time\n",
+	       created_, closed_, evicted_idle_, evicted_full_, max_active_);
+	printf("TCP: %llu segments held out of order, %llu retransmitted bytes dropped, %llu gaps skipped, %llu held segments dropped\n",
+	       reordered_, retransmitted_bytes_, gaps_, dropped_pending_);
+}
@@ -0,0 +1,99 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * flow_table Object
+ */
+
+#ifndef FLOW_TABLE_H
+#define FLOW_TABLE_H
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "common.h"
+#include "pcap_reader.h"
+#include "udfa_flow.h"
+
+#define CPU_FLOW_MAX_PENDING 8 //out-of-order TCP segments held per flow; one more skips the gap before the first of them
+#define CPU_FLOW_BATCH 4096 //capture packets handed from the ingest thread to the flow scan at a time, unless -b is given
+
+//one direction of a TCP connection or UDP exchange; the members leave no padding, so keys compare with memcmp
+typedef struct _flow_key{
+	uint8_t  src[16], dst[16];
+	uint16_t sport, dport;
+	uint8_t  ip_version, proto;
+} flow_key;
+
+struct flow_key_hash {
+	size_t operator()(const flow_key &key) const;
+};
+
+struct flow_key_equal {
+	bool operator()(const flow_key &a, const flow_key &b) const;
+};
+
+//bytes of the capture to scan next in a flow: a payload, or the part of it that is new
+typedef struct _flow_chunk{
+	size_t       offset;
+	unsigned int size;
+} flow_chunk;
+
+//flows of a capture, each one with the scan state of every DFA group (a blob of udfa_flow.h): TCP segments are put
+//back in sequence order, retransmitted bytes are dropped and out-of-order segments are held (as views of the capture,
+//nothing is copied) until the bytes before them arrive, so that a match spanning segments is found without buffering
+//the stream. UDP datagrams are scanned in arrival order. The table holds at most max_flows flows: a flow idle for
+//idle_timeout seconds (of capture time) is dropped, and when the table is full the least recently used one is
+class FlowTable {
+	private:
+		typedef struct _flow{
+			flow_key     key;
+			uint32_t     next_seq;//TCP: sequence number of the next byte to scan
+			bool         fin;//TCP: closed once the bytes before the FIN are scanned, i.e. next_seq reaches fin_seq
+			uint32_t     fin_seq;//TCP: sequence number of the FIN, once fin is set
+			uint64_t     last_seen;//microseconds
+			unsigned int prev, next;//LRU list, most recent first
+			unsigned int n_pending;
+			struct {
+				uint32_t     seq;
+				unsigned int size;
+				size_t       offset;
+			} pending[CPU_FLOW_MAX_PENDING];
+		} flow;
+
+		const udfa_flow_engine *engine_;
+		unsigned int max_flows_;
+		uint64_t idle_timeout_;//microseconds
+		unsigned int state_size_;
+		std::vector<flow> flows_;
+		std::vector<unsigned char> states_;//state blob of flows_[f] at f*state_size_
+		std::vector<unsigned int> free_;
+		std::unordered_map<flow_key, unsigned int, flow_key_hash, flow_key_equal> index_;
+		unsigned int lru_head_, lru_tail_;
+
+		unsigned long long created_, closed_, evicted_idle_, evicted_full_;
+		unsigned long long reordered_, retransmitted_bytes_, gaps_, dropped_pending_;
+		unsigned int max_active_;
+
+		unsigned int lookup(const pcap_packet &pkt, bool *created);
+		void release(unsigned int f);
+		void unlink(unsigned int f);
+		void push_front(unsigned int f);
+		void deliver(flow &fl, uint32_t seq, size_t offset, unsigned int size, std::vector<flow_chunk> &chunks);
+		void drain(flow &fl, std::vector<flow_chunk> &chunks);
+
+		FlowTable(const FlowTable &);
+		FlowTable &operator=(const FlowTable &);
+	public:
+		FlowTable(const udfa_flow_engine *engine, unsigned int max_flows, unsigned int idle_timeout);
+
+		//feeds a packet of the capture: chunks receives the bytes of its flow that can be scanned now, in order, and the
+		//state blob of the flow is returned (valid until the next call), to be passed to udfa_flow_scan with each chunk
+		void *add(const pcap_packet &pkt, std::vector<flow_chunk> &chunks);
+
+		unsigned int get_active() const;
+		void print_stats() const;
+};
+
+#endif
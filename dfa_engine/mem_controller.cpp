@@ -7,25 +7,332 @@
 
 #include "mem_controller.h"
 #include <iostream>
+#ifdef CPU_ONLY
+#include <string.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
 
 using namespace std;
 
-/*MemController::MemController() {
-	return;
-}*/
+#ifdef CPU_ONLY
+//memory policies of mbind and set_mempolicy (linux/mempolicy.h), called through syscall so that libnuma is not needed
+#define NUMA_MPOL_DEFAULT   0
+#define NUMA_MPOL_PREFERRED 1
+#define NUMA_MAX_NODES      1024
+
+static void node_mask(int node, unsigned long *mask) {
+	memset(mask, 0, NUMA_MAX_NODES / 8);
+	mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+}
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#define HOST_PAGE_4K (4096UL)
+#define HOST_PAGE_2M (2UL << 20)
+#define HOST_PAGE_1G (1UL << 30)
+
+static size_t round_up(size_t size, size_t unit) {
+	return (size + unit - 1) / unit * unit;
+}
+
+//maps size bytes with the largest kind of page up to page_policy_ that the allocation fills at least half of;
+//hugetlb pages fall back to smaller ones when the pool has none left. The pages are bound to node (if any),
+//touched so that they are all there before the first scan, and locked with -l
+void *MemController::map_pages(size_t size, int node, size_t *map_size, unsigned int *pages, bool *locked) {
+	void *map = MAP_FAILED;
+	for (int kind = page_policy_; kind >= HOST_PAGES_4K && map == MAP_FAILED; kind--) {
+		*pages = kind;
+		if (kind == HOST_PAGES_1G || kind == HOST_PAGES_2M) {
+			size_t page = (kind == HOST_PAGES_1G) ? HOST_PAGE_1G : HOST_PAGE_2M;
+			if (size < page / 2)
+				continue;
+			*map_size = round_up(size, page);
+			map = mmap(NULL, *map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | ((kind == HOST_PAGES_1G ? 30 : 21) << MAP_HUGE_SHIFT), -1, 0);
+		}
+		else if (kind == HOST_PAGES_THP) {
+			if (size < HOST_PAGE_2M / 2)
+				continue;
+			//transparent huge pages need a 2 MB-aligned range: map one huge page more and trim both ends
+			*map_size = round_up(size, HOST_PAGE_2M);
+			char *raw = (char *) mmap(NULL, *map_size + HOST_PAGE_2M, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (raw == MAP_FAILED)
+				continue;
+			char *aligned = (char *) round_up((size_t)raw, HOST_PAGE_2M);
+			if (aligned > raw)
+				munmap(raw, aligned - raw);
+			munmap(aligned + *map_size, raw + HOST_PAGE_2M - aligned);
+			madvise(aligned, *map_size, MADV_HUGEPAGE);
+			map = aligned;
+		}
+		else {
+			*map_size = round_up(size, HOST_PAGE_4K);
+			map = mmap(NULL, *map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		}
+	}
+	if (map == MAP_FAILED)
+		return 0;
+
+	if (node >= 0 && node < NUMA_MAX_NODES) {
+		//before the pages are touched: they are allocated on node at the first fault. Kernels without NUMA
+		//support fail the call, and the pages come from the only node there is
+		unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+		node_mask(node, mask);
+		syscall(SYS_mbind, map, *map_size, NUMA_MPOL_PREFERRED, mask, NUMA_MAX_NODES + 1, 0);
+	}
+	for (size_t off = 0; off < *map_size; off += HOST_PAGE_4K)
+		((volatile char *) map)[off] = 0;
+	*locked = lock_ && mlock(map, *map_size) == 0;
+	if (lock_ && !*locked)
+		lock_failures_++;
+	return map;
+}
+#endif
+
+MemController::MemController() : page_policy_(HOST_PAGES_THP), lock_(false), lock_failures_(0) {
+}
+
+void MemController::set_page_policy(unsigned int pages) {
+	page_policy_ = pages > HOST_PAGES_1G ? HOST_PAGES_1G : pages;
+}
+
+void MemController::set_lock(bool lock) {
+	lock_ = lock;
+}
+
+void *MemController::alloc(size_t size, int node, const char *what) {
+	host_block block;
+	block.size     = size;
+	block.map      = 0;
+	block.map_size = 0;
+	block.chunk    = 0;
+	block.pages    = HOST_PAGES_4K;
+	block.node     = node;
+	block.locked   = false;
+	block.what     = what;
+	if (size == 0)
+		size = 1;
+
+#ifdef CPU_ONLY
+	if (node < 0 && size < HOST_ARENA_SMALL) {
+		//carved from the last chunk, or from a new one when it is full
+		size_t need = round_up(size, HOST_ALIGN);
+		if (chunks_.empty() || chunks_.back().map == 0 || chunks_.back().used + need > HOST_ARENA_CHUNK) {
+			host_chunk chunk;
+			size_t chunk_size;
+			chunk.map  = (char *) map_pages(HOST_ARENA_CHUNK, -1, &chunk_size, &chunk.pages, &chunk.locked);
+			chunk.used = 0;
+			chunk.live = 0;
+			if (chunk.map == 0) {
+				cout << "Error during mmap\n";
+				return 0;
+			}
+			chunks_.push_back(chunk);
+		}
+		host_chunk &chunk = chunks_.back();
+		block.ptr    = chunk.map + chunk.used;
+		block.chunk  = chunks_.size() - 1;
+		block.pages  = chunk.pages;
+		block.locked = chunk.locked;
+		chunk.used  += need;
+		chunk.live++;
+	}
+	else {
+		block.map = map_pages(size, node, &block.map_size, &block.pages, &block.locked);
+		block.ptr = block.map;
+		if (block.ptr == 0) {
+			cout << "Error during mmap\n";
+			return 0;
+		}
+	}
+#else
+	cudaError_t retval = cudaMallocHost((void **) &block.ptr, size);//page-aligned
+
+	if (retval != cudaSuccess) {
+		cout << "Error during cudaMallocHost\n";
+		return 0;
+	}
+	block.locked = true;//pinned
+#endif
+
+	blocks_.push_back(block);
+	return block.ptr;
+}
+
+void MemController::release(unsigned int b) {
+#ifdef CPU_ONLY
+	host_block &block = blocks_[b];
+	if (block.map)
+		munmap(block.map, block.map_size);
+	else {
+		host_chunk &chunk = chunks_[block.chunk];
+		if (--chunk.live == 0) {
+			if (block.chunk + 1 == chunks_.size())
+				chunk.used = 0;//the chunk allocations are carved from: kept for the next ones
+			else {
+				munmap(chunk.map, HOST_ARENA_CHUNK);
+				chunk.map = 0;
+			}
+		}
+	}
+#else
+	cudaError_t retVal = cudaFreeHost(blocks_[b].ptr);
+	if (retVal != cudaSuccess) cout << "Error during cudaFreeHost" << endl;
+#endif
+}
+
+#ifdef CPU_ONLY
+unsigned int MemController::numa_nodes() {
+	unsigned int n_nodes = 1;
+	DIR *dir = opendir("/sys/devices/system/node");
+	if (dir == NULL)
+		return n_nodes;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		unsigned int node;
+		if (sscanf(entry->d_name, "node%u", &node) == 1 && node < NUMA_MAX_NODES && node + 1 > n_nodes)
+			n_nodes = node + 1;
+	}
+	closedir(dir);
+	return n_nodes;
+}
+
+int MemController::numa_node_of_cpu(unsigned int cpu) {
+	//the directory of a CPU holds a nodeN link to its node
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u", cpu);
+	DIR *dir = opendir(path);
+	if (dir == NULL)
+		return -1;
+	int node = -1;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		unsigned int n;
+		if (sscanf(entry->d_name, "node%u", &n) == 1 && n < NUMA_MAX_NODES) {
+			node = n;
+			break;
+		}
+	}
+	closedir(dir);
+	return node;
+}
+
+void MemController::prefer_node(int node) {
+	if (node < 0 || node >= NUMA_MAX_NODES) {
+		syscall(SYS_set_mempolicy, NUMA_MPOL_DEFAULT, NULL, 0);
+		return;
+	}
+	unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+	node_mask(node, mask);
+	syscall(SYS_set_mempolicy, NUMA_MPOL_PREFERRED, mask, NUMA_MAX_NODES + 1);
+}
+
+size_t MemController::cache_size(unsigned int level) {
+	//the caches of a CPU are listed in sysfs as index0, index1...; sysconf only knows some of them on some libcs
+	for (unsigned int index = 0; ; index++) {
+		char path[96], type[32];
+		unsigned int cache_level, size_kb;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%u/level", index);
+		FILE *file = fopen(path, "r");
+		if (file == NULL)
+			break;
+		int ok = fscanf(file, "%u", &cache_level);
+		fclose(file);
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%u/type", index);
+		file = fopen(path, "r");
+		if (file == NULL)
+			break;
+		ok += fscanf(file, "%31s", type);
+		fclose(file);
+		if (ok != 2 || cache_level != level || strcmp(type, "Instruction") == 0)
+			continue;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%u/size", index);
+		file = fopen(path, "r");
+		if (file == NULL)
+			break;
+		ok = fscanf(file, "%uK", &size_kb);
+		fclose(file);
+		if (ok == 1)
+			return (size_t)size_kb * 1024;
+	}
+	long size = -1;
+	if (level == 1)
+		size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+	else if (level == 2)
+		size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	else if (level == 3)
+		size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+	return size > 0 ? (size_t)size : 0;
+}
+#endif
 
 /*MemController::~MemController() {
 }*/
 
-void MemController::dealloc_host_all() {
-	for(unsigned int i=0; i < host_.size(); i++){
-        cudaError_t retVal = cudaFreeHost(host_[i]);
-        if (retVal != cudaSuccess) cout << "Error during cudaFreeHost" << endl;
+void MemController::dealloc_host(void *ptr) {
+	for(unsigned int i=0; i < blocks_.size(); i++){
+		if (blocks_[i].ptr == ptr) {
+			release(i);
+			blocks_.erase(blocks_.begin() + i);
+			return;
+		}
 	}
-    host_.clear();
-    return;
+	return;
+}
+
+void MemController::dealloc_host_all() {
+	for(unsigned int i=0; i < blocks_.size(); i++)
+		release(i);
+	blocks_.clear();
+#ifdef CPU_ONLY
+	for(unsigned int c=0; c < chunks_.size(); c++)
+		if (chunks_[c].map)
+			munmap(chunks_[c].map, HOST_ARENA_CHUNK);
+#endif
+	chunks_.clear();
+	return;
 }
 
 unsigned int MemController::get_host_size(){
-	return host_.size();
+	return blocks_.size();
+}
+
+void MemController::print_report() const {
+	static const char *page_names[] = {"4 KB pages", "transparent huge pages", "2 MB pages", "1 GB pages"};
+	size_t total = 0, mapped = 0;
+	for (unsigned int i = 0; i < blocks_.size(); i++) {
+		total  += blocks_[i].size;
+		mapped += blocks_[i].map_size;
+	}
+	for (unsigned int c = 0; c < chunks_.size(); c++)
+		if (chunks_[c].map)
+			mapped += HOST_ARENA_CHUNK;
+
+	printf("Host memory: %u allocations, %.2f MB", (unsigned int)blocks_.size(), total/1048576.0);
+#ifdef CPU_ONLY
+	printf(" (%.2f MB mapped)", mapped/1048576.0);
+#endif
+	printf("\n");
+	if (lock_failures_)
+		printf("Host memory: %u mappings could not be locked, see ulimit -l\n", lock_failures_);
+	for (unsigned int i = 0; i < blocks_.size(); i++) {
+		const host_block &block = blocks_[i];
+		printf("   + %s: %zu bytes", block.what.c_str(), block.size);
+#ifdef CPU_ONLY
+		if (block.map == 0)
+			printf(", arena chunk %u", block.chunk);
+		printf(", %s", page_names[block.pages]);
+		if (block.node >= 0)
+			printf(", node %d", block.node);
+		if (block.locked)
+			printf(", locked");
+#else
+		printf(", pinned");
+#endif
+		printf("\n");
+	}
 }
@@ -9,40 +9,94 @@
 #define MEM_CONTROLLER_H
 
 #include <iostream>
+#ifndef CPU_ONLY
 #include <cuda.h>
 #include <cuda_runtime.h>
+#endif
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string>
 #include <vector>
 
 using namespace std;
 
+#define HOST_ALIGN       64 //bytes: every host allocation starts on a cache line
+#define HOST_ARENA_CHUNK (2UL << 20) //CPU engine: allocations of fewer than HOST_ARENA_SMALL bytes are carved from chunks of this size
+#define HOST_ARENA_SMALL (256UL << 10)
+
+//CPU engine: pages of a host allocation (-H), each kind falling back to the previous one when it cannot be had
+#define HOST_PAGES_4K  0 //base pages
+#define HOST_PAGES_THP 1 //transparent huge pages, asked for with madvise
+#define HOST_PAGES_2M  2 //2 MB pages from the hugetlb pool
+#define HOST_PAGES_1G  3 //1 GB pages from the hugetlb pool
+
 class MemController {
 	private:
-		std::vector<void *> host_;
+		typedef struct _host_block{
+			void         *ptr;//HOST_ALIGN-aligned
+			size_t        size;//bytes asked for
+			void         *map;//CPU engine: mapping of its own, NULL if carved from chunks_[chunk]
+			size_t        map_size;
+			unsigned int  chunk;
+			unsigned int  pages;//HOST_PAGES_* actually used
+			int           node;//NUMA node asked for (-1 - none)
+			bool          locked;
+			std::string   what;//for the report
+		} host_block;
+
+		//CPU engine: small allocations are packed into chunks, so that small tables share pages (and TLB entries)
+		typedef struct _host_chunk{
+			char         *map;//NULL once released
+			size_t        used;
+			unsigned int  live;//blocks carved from it and not released yet
+			unsigned int  pages;
+			bool          locked;
+		} host_chunk;
+
+		std::vector<host_block> blocks_;
+		std::vector<host_chunk> chunks_;
+		unsigned int page_policy_;//largest HOST_PAGES_* to use
+		bool lock_;//mlock every mapping
+		unsigned int lock_failures_;
+
+		void *alloc(size_t size, int node, const char *what);
+		void release(unsigned int b);
+#ifdef CPU_ONLY
+		void *map_pages(size_t size, int node, size_t *map_size, unsigned int *pages, bool *locked);
+#endif
 
 	public:
-		//MemController();
+		MemController();
 		//~MemController();
 
+		//size bytes, HOST_ALIGN-aligned and not initialized; what names the allocation in print_report. The CPU engine maps
+		//them with the pages of set_page_policy and touches every page before returning, so that scans never fault on them
 		template<typename T>
-			T *alloc_host(size_t size) {
-				T *ptr(0);
-
-	            cudaError_t retval = cudaMallocHost((void **) &ptr, size);
-                
-	            if (retval !=cudaSuccess) {
-                    cout << "Error during cudaMallocHost\n";
-                    ptr = 0;
-                }
-                else
-                    host_.push_back(ptr);				
-
-				return ptr;
+			T *alloc_host(size_t size, const char *what = "host") {
+				return (T *) alloc(size, -1, what);
 			}
 
+#ifdef CPU_ONLY
+		//CPU engine: as alloc_host, with pages that come from NUMA node node (from other nodes only when it runs out of memory)
+		template<typename T>
+			T *alloc_host_on_node(size_t size, int node, const char *what = "host") {
+				return (T *) alloc(size, node, what);
+			}
+
+		static unsigned int numa_nodes();//1 + the highest NUMA node id (1 without NUMA support)
+		static int numa_node_of_cpu(unsigned int cpu);//-1 if unknown
+		static void prefer_node(int node);//pages later allocated by the calling thread come from node (-1 - the default policy)
+		static size_t cache_size(unsigned int level);//bytes of the level 1 (data), 2 or 3 cache of the first CPU, 0 if unknown
+#endif
+
+		void set_page_policy(unsigned int pages);
+		void set_lock(bool lock);
+
+		void dealloc_host(void *ptr);
 		void dealloc_host_all();
 		unsigned int get_host_size();
+		void print_report() const;//bytes, pages and node of every allocation
 };
 
 #endif
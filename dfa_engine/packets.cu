@@ -4,35 +4,146 @@
  *
  * packets.cu
  */
- 
+
 #include "packets.h"
 #include <vector>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
-/*Packets::Packets() {
+Packets::Packets() : payloads_(NULL), input_size_(0), mapping_(NULL), mapping_size_(0) {
 }
+
 Packets::~Packets() {
-}*/
+	if (mapping_)
+		munmap(mapping_, mapping_size_);
+}
+
+bool Packets::map_input(const char *file_name) {
+	int fd = open(file_name, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		//zero pages first, then the file mapped over their beginning: the padding of the last packet reads as zeros
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t size = st.st_size;
+		size_t mapping_size = (size + fetch_bytes + page - 1) / page * page;
+		void *mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapping != MAP_FAILED) {
+			if (mmap(mapping, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED) {
+				madvise(mapping, size, MADV_WILLNEED);//read ahead while the packets are set up
+				close(fd);
+				mapping_      = mapping;
+				mapping_size_ = mapping_size;
+				payloads_     = (const symbol *)mapping;
+				input_size_   = size;
+				return true;
+			}
+			munmap(mapping, mapping_size);
+		}
+	}
+
+	//not a regular file (or it cannot be mapped): read it into memory
+	symbol chunk[65536];
+	ssize_t n;
+	while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+		buffer_.insert(buffer_.end(), chunk, chunk + n);
+	close(fd);
+	input_size_ = buffer_.size();
+	buffer_.resize(input_size_ + fetch_bytes, 0);
+	payloads_ = &buffer_[0];
+	return true;
+}
+
+size_t Packets::get_input_size() const {
+	return input_size_;
+}
+
+void Packets::share_input(const Packets &input) {
+	payloads_   = input.payloads_;
+	input_size_ = input.input_size_;
+}
+
+void Packets::prefault_input(size_t begin, size_t end) const {
+	if (!mapping_ || begin >= end)
+		return;
+	size_t page = sysconf(_SC_PAGESIZE);
+	begin = begin / page * page;
+	madvise((char *)mapping_ + begin, end - begin, MADV_WILLNEED);
+	//one read per page, so that the reads from the file are done here rather than in the scan
+	volatile symbol sink = 0;
+	for (size_t b = begin; b < end; b += page)
+		sink += payloads_[b];
+}
 
-void Packets::add_packet(const std::vector<unsigned char> payload) {
-	payloads_.insert(payloads_.end(), payload.begin(), payload.end());
-	payload_sizes_.push_back(payload.size());
+void Packets::release_input(size_t begin, size_t end) const {
+	if (!mapping_)
+		return;
+	//bytes before begin are done with as well, but the page around end may still hold bytes of the next batch
+	size_t page = sysconf(_SC_PAGESIZE);
+	begin = begin / page * page;
+	end   = end / page * page;
+	if (begin < end)
+		madvise((char *)mapping_ + begin, end - begin, MADV_DONTNEED);
 }
 
-const vector<symbol> &Packets::get_payloads(void) {
+void Packets::add_packet(size_t stream_offset, unsigned int data_size, unsigned int overlap) {
+	//version 2 -- note: padding to each packet if packet_size is not evenly divided by fetch_bytes (e.g. 4, 8)
+	unsigned int padding = (data_size % fetch_bytes != 0) ? fetch_bytes - data_size % fetch_bytes : 0;
+	padded_sizes_.push_back(padding + (padded_sizes_.empty() ? 0 : padded_sizes_.back()));//Note: Accumulating the numbers of padded bytes of each packet
+	payload_offsets_.push_back(stream_offset);
+	payload_sizes_.push_back(data_size + padding);
+	data_sizes_.push_back(data_size);
+	stream_offsets_.push_back(stream_offset);
+	overlap_sizes_.push_back(overlap);
+}
+
+const symbol *Packets::get_payloads(void) const {
 	return payloads_;
 }
 
+const vector<size_t> &Packets::get_payload_offsets() {
+	return payload_offsets_;
+}
+
 const vector<unsigned int> &Packets::get_payload_sizes() {
 	return payload_sizes_;
 }
 
-//note: padding to each packet if packet_size is not evenly divided by fetch_bytes (e.g. 4, 8)
-void Packets::set_padded_bytes(unsigned int nbytes){
-	padded_sizes_.push_back(nbytes + (padded_sizes_.empty() ? 0 : padded_sizes_.back()));//Note: Accumulating the numbers of padded bytes of each packet
+void Packets::copy_packets(symbol *dst, unsigned int stride) const {
+	for (unsigned int j = 0; j < payload_sizes_.size(); j++) {
+		memcpy(dst, payloads_ + payload_offsets_[j], data_sizes_[j]);
+		memset(dst + data_sizes_[j], 0, stride - data_sizes_[j]);
+		dst += stride;
+	}
+}
+
+unsigned int Packets::get_max_payload_size() const {
+	unsigned int size = 0;
+	for (unsigned int j = 0; j < payload_sizes_.size(); j++)
+		if (payload_sizes_[j] > size)
+			size = payload_sizes_[j];
+	return size;
 }
 
 const vector<unsigned int> &Packets::get_padded_sizes() {
 	return padded_sizes_;
 }
+
+const vector<unsigned int> &Packets::get_data_sizes() {
+	return data_sizes_;
+}
+
+const vector<size_t> &Packets::get_stream_offsets() {
+	return stream_offsets_;
+}
+
+const vector<unsigned int> &Packets::get_overlap_sizes() {
+	return overlap_sizes_;
+}
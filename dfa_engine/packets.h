@@ -9,26 +9,60 @@
 #define PACKETS_H
 
 #include <vector>
+#include <stddef.h>
 #include "common.h"
 
 using namespace std;
 
+//packets are views of the input stream, which is memory-mapped: packet j is the payload_sizes_[j] bytes at
+//payload_offsets_[j] of get_payloads(), i.e. its data followed by its padding to a multiple of fetch_bytes.
+//The padding is whatever follows the data (the next bytes of the input, or zeros past its end) and is never reported
 class Packets {
 	private:
-		vector<symbol>payloads_;
+		const symbol *payloads_;//input stream
+		size_t input_size_;
+		void *mapping_;//mmap of the input file and the zero bytes after it (NULL if the input was read into buffer_)
+		size_t mapping_size_;
+		vector<symbol> buffer_;//input that cannot be mapped (e.g. a pipe), followed by zero bytes
+		vector<size_t> payload_offsets_;//offset of the first byte of each packet in payloads_
 		vector<unsigned int> payload_sizes_;
-		vector<unsigned int> padded_sizes_;//store the numbers of padded bytes of each packet 
+		vector<unsigned int> padded_sizes_;//store the numbers of padded bytes of each packet
 		                                   //note: padding to each packet if packet_size is not evenly divided by fetch_bytes (e.g. 4, 8)
+		vector<unsigned int> data_sizes_;//input bytes of each packet (padding excluded)
+		vector<size_t> stream_offsets_;//offset of the first byte of each packet in the input stream
+		vector<unsigned int> overlap_sizes_;//leading bytes of each packet already covered by the previous packet (-S 1)
+
+		Packets(const Packets &);
+		Packets &operator=(const Packets &);
 	public:
-		//Packets();
-		//~Packets();
-		void add_packet(const std::vector<unsigned char> payload);
-		const vector<symbol> &get_payloads(void);		
+		Packets();
+		~Packets();
+		//maps the input file (reads it if it cannot be mapped); false if it cannot be opened
+		bool map_input(const char *file_name);
+		size_t get_input_size() const;
+		//batches: packets of a batch are added to a Packets that shares the input of the one that mapped it
+		void share_input(const Packets &input);
+		//batches: reads the pages of bytes [begin, end) of the input ahead of the scan, or drops them once all bytes before end are scanned
+		void prefault_input(size_t begin, size_t end) const;
+		void release_input(size_t begin, size_t end) const;
+
+		//packet of data_size bytes starting at stream_offset in the input stream, whose first overlap bytes belong to the previous packet
+		void add_packet(size_t stream_offset, unsigned int data_size, unsigned int overlap);
+		const symbol *get_payloads(void) const;
+		const vector<size_t> &get_payload_offsets(void);
 		const vector<unsigned int> &get_payload_sizes(void);
+		//writes packet j at dst + j*stride, padded with zeros up to stride (at least get_max_payload_size()), e.g. for a
+		//device copy whose kernels find packet j at a fixed stride
+		void copy_packets(symbol *dst, unsigned int stride) const;
+		//largest packet, padding included: the stride of copy_packets
+		unsigned int get_max_payload_size() const;
 
 		//note: padding to each packet if packet_size is not evenly divided by fetch_bytes (e.g. 4, 8)
-		void set_padded_bytes(unsigned int nbytes);
 		const vector<unsigned int> &get_padded_sizes(void);
+
+		const vector<unsigned int> &get_data_sizes(void);
+		const vector<size_t> &get_stream_offsets(void);
+		const vector<unsigned int> &get_overlap_sizes(void);
 };
 
 #endif
@@ -0,0 +1,331 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * pcap_reader.cpp
+ */
+
+#include "pcap_reader.h"
+#include <string.h>
+
+using namespace std;
+
+//header fields of the network and transport layers are big-endian whatever the byte order of the capture
+static inline uint16_t be16(const symbol *p) {
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t be32(const symbol *p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint32_t le32(const symbol *p) {
+	return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+PcapReader::PcapReader() : data_(NULL), size_(0), pos_(0), pcapng_(false), big_endian_(false), linktype_(0), ts_scale_(1), records_(0), payloads_(0) {
+}
+
+uint16_t PcapReader::rd16(size_t off) const {
+	const symbol *p = data_ + off;
+	return big_endian_ ? be16(p) : (uint16_t)((p[1] << 8) | p[0]);
+}
+
+uint32_t PcapReader::rd32(size_t off) const {
+	return big_endian_ ? be32(data_ + off) : le32(data_ + off);
+}
+
+bool PcapReader::is_capture(const symbol *data, size_t size) {
+	if (size >= 24) {
+		uint32_t magic = le32(data);
+		if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC || be32(data) == PCAP_MAGIC_USEC || be32(data) == PCAP_MAGIC_NSEC)
+			return true;
+	}
+	return size >= 28 && le32(data) == PCAPNG_SHB && (le32(data + 8) == PCAPNG_BYTE_ORDER || be32(data + 8) == PCAPNG_BYTE_ORDER);
+}
+
+bool PcapReader::open(const symbol *data, size_t size) {
+	data_    = data;
+	size_    = size;
+	records_ = 0;
+	payloads_= 0;
+	if (!is_capture(data, size))
+		return false;
+
+	pcapng_ = (le32(data) == PCAPNG_SHB);
+	if (pcapng_) {
+		pos_ = 0;//the section header block is read like the other blocks
+		return true;
+	}
+	big_endian_ = (be32(data) == PCAP_MAGIC_USEC || be32(data) == PCAP_MAGIC_NSEC);
+	ts_scale_   = (rd32(0) == PCAP_MAGIC_NSEC) ? 1000 : 1;
+	linktype_   = rd32(20) & 0xFFFF;//the upper bits tell about the FCS
+	pos_        = 24;
+	return true;
+}
+
+bool PcapReader::section_header(size_t block, size_t block_len) {
+	//the byte order of a section is the one that reads its byte-order magic right
+	big_endian_ = (be32(data_ + block + 8) == PCAPNG_BYTE_ORDER);
+	if (rd32(block + 8) != PCAPNG_BYTE_ORDER || block_len < 28)
+		return false;
+	if_linktypes_.clear();
+	if_ts_per_sec_.clear();
+	return true;
+}
+
+void PcapReader::interface_description(size_t block, size_t block_len) {
+	uint64_t ts_per_sec = 1000000;//default if_tsresol: microseconds
+	//options: code, length, value padded to 4 bytes; if_tsresol (9) is a power of 10, or of 2 if its top bit is set
+	for (size_t opt = block + 16; opt + 4 <= block + block_len - 4; ) {
+		uint16_t code = rd16(opt), len = rd16(opt + 2);
+		if (code == 0 || opt + 4 + len > block + block_len - 4)
+			break;
+		if (code == 9 && len >= 1) {
+			symbol resol = data_[opt + 4];
+			ts_per_sec = 1;
+			for (unsigned int i = 0; i < (resol & 0x7F) && ts_per_sec < 1000000000000000000ULL; i++)
+				ts_per_sec *= (resol & 0x80) ? 2 : 10;
+		}
+		opt += 4 + ((len + 3) & ~3);
+	}
+	if_linktypes_.push_back(rd16(block + 8));
+	if_ts_per_sec_.push_back(ts_per_sec);
+}
+
+//moves to the next captured frame; false at the end of the capture or at a truncated record
+bool PcapReader::next_frame(unsigned int *linktype, size_t *frame, unsigned int *caplen, uint64_t *ts_usec) {
+	if (!pcapng_) {
+		if (pos_ + 16 > size_)
+			return false;
+		*caplen = rd32(pos_ + 8);
+		if (*caplen > size_ - pos_ - 16)
+			return false;
+		*ts_usec  = (uint64_t)rd32(pos_) * 1000000 + rd32(pos_ + 4) / ts_scale_;
+		*linktype = linktype_;
+		*frame    = pos_ + 16;
+		pos_     += 16 + *caplen;
+		return true;
+	}
+
+	while (pos_ + 12 <= size_) {
+		size_t block = pos_;
+		uint32_t type = rd32(block);
+		if (type == PCAPNG_SHB && !section_header(block, rd32(block + 4)))
+			return false;
+		size_t block_len = rd32(block + 4);
+		if (block_len < 12 || block_len % 4 != 0 || block_len > size_ - block)
+			return false;
+		pos_ += block_len;
+
+		unsigned int if_id;
+		uint64_t ts = 0;
+		if (type == 1) {//interface description
+			if (block_len >= 20)
+				interface_description(block, block_len);
+			continue;
+		}
+		else if (type == 6 && block_len >= 32) {//enhanced packet: interface, timestamp (high, low), captured length
+			if_id   = rd32(block + 8);
+			ts      = ((uint64_t)rd32(block + 12) << 32) | rd32(block + 16);
+			*caplen = rd32(block + 20);
+			*frame  = block + 28;
+		}
+		else if (type == 3 && block_len >= 16) {//simple packet: original length, first interface, no timestamp
+			if_id   = 0;
+			*caplen = rd32(block + 8);
+			*frame  = block + 12;
+		}
+		else if (type == 2 && block_len >= 32) {//obsolete packet block: 16-bit interface, drops, then as the enhanced one
+			if_id   = rd16(block + 8);
+			ts      = ((uint64_t)rd32(block + 12) << 32) | rd32(block + 16);
+			*caplen = rd32(block + 20);
+			*frame  = block + 28;
+		}
+		else
+			continue;//statistics, name resolution, custom blocks...
+
+		if (*caplen > block + block_len - 4 - *frame)
+			*caplen = block + block_len - 4 - *frame;//simple packets: the original length may exceed the snapshot
+		if (if_id >= if_linktypes_.size())
+			continue;
+		uint64_t ts_per_sec = if_ts_per_sec_[if_id];
+		*ts_usec  = (ts_per_sec >= 1000000) ? ts / (ts_per_sec / 1000000) : ts * (1000000 / ts_per_sec);
+		*linktype = if_linktypes_[if_id];
+		return true;
+	}
+	return false;
+}
+
+//finds the TCP or UDP payload of a frame; false if the frame holds none
+bool PcapReader::decode(unsigned int linktype, size_t frame, unsigned int caplen, pcap_packet *pkt) const {
+	const symbol *p = data_ + frame;
+	size_t end = caplen;
+	size_t l3;
+	unsigned int ethertype;
+
+	switch (linktype) {
+		case 1://Ethernet
+			if (end < 14)
+				return false;
+			ethertype = be16(p + 12);
+			l3 = 14;
+			while (ethertype == 0x8100 || ethertype == 0x88A8 || ethertype == 0x9100) {//VLAN tags
+				if (end < l3 + 4)
+					return false;
+				ethertype = be16(p + l3 + 2);
+				l3 += 4;
+			}
+			break;
+		case 113://Linux cooked capture
+			if (end < 16)
+				return false;
+			ethertype = be16(p + 14);
+			l3 = 16;
+			break;
+		case 276://Linux cooked capture v2
+			if (end < 20)
+				return false;
+			ethertype = be16(p);
+			l3 = 20;
+			break;
+		case 0://BSD loopback: address family in the byte order of the capturing machine (of the capture)
+		case 109: {//OpenBSD loopback: network byte order
+			if (end < 4)
+				return false;
+			uint32_t family = (linktype == 0) ? rd32(frame) : be32(p);
+			ethertype = (family == 2) ? 0x0800 : (family == 24 || family == 28 || family == 30) ? 0x86DD : 0;
+			l3 = 4;
+			break;
+		}
+		case 101://raw IP
+		case 228://raw IPv4
+		case 229://raw IPv6
+			if (end < 1)
+				return false;
+			ethertype = ((p[0] >> 4) == 4) ? 0x0800 : ((p[0] >> 4) == 6) ? 0x86DD : 0;
+			l3 = 0;
+			break;
+		default:
+			return false;
+	}
+
+	size_t l4;
+	unsigned int proto;
+	memset(pkt->src, 0, sizeof(pkt->src));
+	memset(pkt->dst, 0, sizeof(pkt->dst));
+	if (ethertype == 0x0800) {
+		if (end < l3 + 20 || (p[l3] >> 4) != 4)
+			return false;
+		size_t ihl = (p[l3] & 15) * 4, total = be16(p + l3 + 2);
+		if (ihl < 20 || total < ihl || end < l3 + ihl)
+			return false;
+		if (be16(p + l3 + 6) & 0x1FFF)//a later fragment: no transport header
+			return false;
+		if (l3 + total < end)
+			end = l3 + total;//Ethernet trailer
+		proto = p[l3 + 9];
+		memcpy(pkt->src, p + l3 + 12, 4);
+		memcpy(pkt->dst, p + l3 + 16, 4);
+		pkt->ip_version = 4;
+		l4 = l3 + ihl;
+	}
+	else if (ethertype == 0x86DD) {
+		if (end < l3 + 40 || (p[l3] >> 4) != 6)
+			return false;
+		size_t plen = be16(p + l3 + 4);
+		if (plen != 0 && l3 + 40 + plen < end)//0: jumbogram, the frame tells the length
+			end = l3 + 40 + plen;
+		proto = p[l3 + 6];
+		memcpy(pkt->src, p + l3 + 8, 16);
+		memcpy(pkt->dst, p + l3 + 24, 16);
+		pkt->ip_version = 6;
+		l4 = l3 + 40;
+		//extension headers: hop-by-hop, routing, fragment, authentication, destination options
+		while (proto == 0 || proto == 43 || proto == 44 || proto == 51 || proto == 60) {
+			if (end < l4 + 8)
+				return false;
+			size_t len;
+			if (proto == 44) {
+				if (be16(p + l4 + 2) & 0xFFF8)//a later fragment
+					return false;
+				len = 8;
+			}
+			else if (proto == 51)
+				len = (p[l4 + 1] + 2) * 4;
+			else
+				len = (p[l4 + 1] + 1) * 8;
+			proto = p[l4];
+			l4 += len;
+		}
+	}
+	else
+		return false;
+
+	size_t payload;
+	if (proto == PCAP_PROTO_TCP) {
+		if (end < l4 + 20)
+			return false;
+		size_t doff = (p[l4 + 12] >> 4) * 4;
+		if (doff < 20 || end < l4 + doff)
+			return false;
+		pkt->seq       = be32(p + l4 + 4);
+		pkt->tcp_flags = p[l4 + 13];
+		payload = l4 + doff;
+	}
+	else if (proto == PCAP_PROTO_UDP) {
+		if (end < l4 + 8)
+			return false;
+		size_t ulen = be16(p + l4 + 4);
+		if (ulen >= 8 && l4 + ulen < end)
+			end = l4 + ulen;
+		pkt->seq       = 0;
+		pkt->tcp_flags = 0;
+		payload = l4 + 8;
+	}
+	else
+		return false;
+
+	pkt->proto  = proto;
+	pkt->sport  = be16(p + l4);
+	pkt->dport  = be16(p + l4 + 2);
+	pkt->offset = frame + payload;
+	pkt->size   = end - payload;
+	return true;
+}
+
+bool PcapReader::next(pcap_packet *pkt) {
+	unsigned int linktype, caplen;
+	size_t frame;
+	uint64_t ts_usec;
+	while (next_frame(&linktype, &frame, &caplen, &ts_usec)) {
+		records_++;
+		if (decode(linktype, frame, caplen, pkt)) {
+			pkt->ts_usec = ts_usec;
+			if (pkt->size)
+				payloads_++;
+			return true;
+		}
+	}
+	return false;
+}
+
+unsigned int PcapReader::next_batch(Packets &packets, unsigned int max_packets) {
+	unsigned int n_packets = 0;
+	pcap_packet pkt;
+	while (n_packets < max_packets && next(&pkt)) {
+		if (pkt.size == 0)
+			continue;
+		packets.add_packet(pkt.offset, pkt.size, 0);
+		n_packets++;
+	}
+	return n_packets;
+}
+
+unsigned long long PcapReader::get_records() const {
+	return records_;
+}
+
+unsigned long long PcapReader::get_payloads() const {
+	return payloads_;
+}
@@ -0,0 +1,83 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * pcap_reader Object
+ */
+
+#ifndef PCAP_READER_H
+#define PCAP_READER_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "packets.h"
+
+#define PCAP_MAGIC_USEC   0xA1B2C3D4 //classic pcap, microsecond timestamps
+#define PCAP_MAGIC_NSEC   0xA1B23C4D //classic pcap, nanosecond timestamps
+#define PCAPNG_SHB        0x0A0D0D0A //pcapng section header block
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4D
+
+#define PCAP_PROTO_TCP 6
+#define PCAP_PROTO_UDP 17
+
+//TCP or UDP payload of one captured packet: a view of the capture (offset and size in the mapped file), with the
+//addresses, ports and, for TCP, the sequence number and flags needed to put it back into its flow
+typedef struct _pcap_packet{
+	size_t   offset;//first payload byte in the capture file
+	unsigned int size;
+	uint64_t ts_usec;//capture time, microseconds
+	uint8_t  ip_version;//4 or 6
+	uint8_t  proto;//PCAP_PROTO_TCP or PCAP_PROTO_UDP
+	uint8_t  tcp_flags;
+	uint8_t  src[16], dst[16];//IPv4 addresses in the first 4 bytes, the rest is 0
+	uint16_t sport, dport;
+	uint32_t seq;//TCP sequence number of the first payload byte
+} pcap_packet;
+
+//parses a pcap or pcapng capture in place: nothing is copied, the payloads are delivered as views of the mapped file.
+//Link layers: Ethernet (with VLAN tags), Linux cooked (SLL, SLL2), BSD loopback and raw IP; network layers: IPv4
+//(first fragments only) and IPv6 (with extension headers); other packets are skipped
+class PcapReader {
+	private:
+		const symbol *data_;
+		size_t size_;
+		size_t pos_;//next record (pcap) or block (pcapng)
+		bool pcapng_;
+		bool big_endian_;//byte order of the capture (pcapng: of the current section)
+		unsigned int linktype_;//pcap
+		uint64_t ts_scale_;//pcap: timestamp units per microsecond (1 or 1000)
+		std::vector<unsigned int> if_linktypes_;//pcapng: link type of each interface of the section
+		std::vector<uint64_t> if_ts_per_sec_;//pcapng: timestamp units per second of each interface
+		unsigned long long records_;
+		unsigned long long payloads_;
+
+		uint16_t rd16(size_t off) const;
+		uint32_t rd32(size_t off) const;
+		bool next_frame(unsigned int *linktype, size_t *frame, unsigned int *caplen, uint64_t *ts_usec);
+		bool section_header(size_t block, size_t block_len);
+		void interface_description(size_t block, size_t block_len);
+		bool decode(unsigned int linktype, size_t frame, unsigned int caplen, pcap_packet *pkt) const;
+
+		PcapReader(const PcapReader &);
+		PcapReader &operator=(const PcapReader &);
+	public:
+		PcapReader();
+		//true if data starts with a pcap or pcapng header
+		static bool is_capture(const symbol *data, size_t size);
+		//false if data is not a capture this reader understands
+		bool open(const symbol *data, size_t size);
+
+		//next TCP or UDP packet of the capture, whose payload may be empty (e.g. a TCP SYN); false at the end of the
+		//capture or at the first truncated record
+		bool next(pcap_packet *pkt);
+		//adds the next max_packets non-empty payloads (or the ones left) to packets; returns how many were added
+		unsigned int next_batch(Packets &packets, unsigned int max_packets);
+
+		unsigned long long get_records() const;//records read so far
+		unsigned long long get_payloads() const;//non-empty payloads delivered so far
+};
+
+#endif
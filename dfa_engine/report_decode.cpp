@@ -0,0 +1,88 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * report_decode.cpp
+ *
+ * Turns a binary report written by the engine with -B 1 (Report_*.bin) back into
+ * the text report it would have written without it (Report_*.txt).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "report_writer.h"
+
+static uint64_t read_le(const unsigned char *bytes, unsigned int n_bytes){
+	uint64_t value = 0;
+	for (unsigned int b = 0; b < n_bytes; b++)
+		value |= (uint64_t)bytes[b] << (8 * b);
+	return value;
+}
+
+//closes the input and output files (not standard output) and returns status
+static int finish(FILE *in, FILE *out, int status){
+	fclose(in);
+	if (out != stdout && fclose(out) != 0)
+		status = 1;
+	return status;
+}
+
+//diagnostics go to standard error: standard output may be the text report
+int main(int argc, char **argv){
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "USAGE: ./report_decode <binary report> [<text report>]\n");
+		fprintf(stderr, "\tWrites the text report to standard output when no output file is given\n");
+		return 1;
+	}
+
+	FILE *in = fopen(argv[1], "rb");
+	if (in == NULL) {
+		fprintf(stderr, "Cannot open %s\n", argv[1]);
+		return 1;
+	}
+	FILE *out = (argc == 3) ? fopen(argv[2], "w") : stdout;
+	if (out == NULL) {
+		fprintf(stderr, "Cannot open %s\n", argv[2]);
+		fclose(in);
+		return 1;
+	}
+
+	unsigned char header[REPORT_HEADER_SIZE];
+	if (fread(header, 1, REPORT_HEADER_SIZE, in) != REPORT_HEADER_SIZE || read_le(header, 4) != REPORT_MAGIC) {
+		fprintf(stderr, "%s is not a binary report\n", argv[1]);
+		return finish(in, out, 1);
+	}
+	if (read_le(header + 4, 4) != REPORT_VERSION) {
+		fprintf(stderr, "%s: unsupported report version %u\n", argv[1], (unsigned int)read_le(header + 4, 4));
+		return finish(in, out, 1);
+	}
+	unsigned int n_matches = (unsigned int)read_le(header + 12, 4);
+	uint64_t     n_records = read_le(header + 16, 8);
+
+	//records of one match are consecutive and share its offset
+	fprintf(out, "REPORTS: Total matches: %u\n", n_matches);
+	unsigned char record[REPORT_RECORD_SIZE];
+	uint64_t last_off = 0;
+	for (uint64_t r = 0; r < n_records; r++) {
+		if (fread(record, 1, REPORT_RECORD_SIZE, in) != REPORT_RECORD_SIZE) {
+			fprintf(stderr, "%s: truncated after %llu of %llu records\n", argv[1], (unsigned long long)r, (unsigned long long)n_records);
+			return finish(in, out, 1);
+		}
+		uint64_t off  = read_le(record, 8);
+		uint32_t rule = (uint32_t)read_le(record + 8, 4);
+		if (r == 0 || off != last_off)
+			fprintf(out, "%llu::\n", (unsigned long long)off);
+		if (rule != REPORT_NO_RULE)
+			fprintf(out, "    Rule: %u\n", rule);
+		last_off = off;
+	}
+
+	if (fflush(out) != 0) {
+		fprintf(stderr, "Cannot write the text report\n");
+		return finish(in, out, 1);
+	}
+	return finish(in, out, 0);
+}
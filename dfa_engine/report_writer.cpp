@@ -0,0 +1,165 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * report_writer.cpp
+ */
+
+#include "report_writer.h"
+#include <iostream>
+#include <stdio.h>
+
+using namespace std;
+
+ReportWriter::ReportWriter(bool batches) : queue_(REPORT_QUEUE_SIZE), batches_(batches), bytes_written_(0) {
+	thread_ = std::thread(&ReportWriter::run, this);
+}
+
+ReportWriter::~ReportWriter() {
+	close();
+}
+
+void ReportWriter::run() {
+	while (1) {
+		std::pair<std::string, std::string> job;
+		queue_.pop(job);
+		if (job.first.empty())
+			break;
+		if (batches_)
+			append(job.first, job.second);
+		else
+			write(job.first, job.second);
+	}
+	if (batches_)
+		finish();
+}
+
+void ReportWriter::write(const std::string &filename, const std::string &report) {
+	FILE *fp = fopen(filename.c_str(), "wb");
+	size_t written = 0;
+	if (fp == NULL)
+		cout << "Error opening report file " << filename << endl;
+	else {
+		written = fwrite(report.data(), 1, report.size(), fp);
+		if (written != report.size())
+			cout << "Error writing report file " << filename << endl;
+		fclose(fp);
+	}
+	bytes_written_ += written;
+}
+
+static uint64_t read_le(const char *bytes, unsigned int n_bytes) {
+	uint64_t value = 0;
+	for (unsigned int b = 0; b < n_bytes; b++)
+		value |= (uint64_t)(unsigned char)bytes[b] << (8 * b);
+	return value;
+}
+
+void ReportWriter::append(const std::string &filename, const std::string &report) {
+	//header of this batch: counts are added up, the rest of the report goes to the part file
+	size_t body_start;
+	uint32_t group = 0, n_matches = 0;
+	uint64_t n_records = 0;
+	bool binary = (report.size() >= REPORT_HEADER_SIZE && read_le(report.data(), 4) == REPORT_MAGIC);
+	if (binary) {
+		group     = read_le(report.data() + 8, 4);
+		n_matches = read_le(report.data() + 12, 4);
+		n_records = read_le(report.data() + 16, 8);
+		body_start = REPORT_HEADER_SIZE;
+	}
+	else {
+		body_start = report.find('\n');
+		body_start = (body_start == std::string::npos) ? report.size() : body_start + 1;
+		sscanf(report.c_str(), "REPORTS: Total matches: %u", &n_matches);
+	}
+
+	std::map<std::string, report_part>::iterator p = parts_.find(filename);
+	if (p == parts_.end()) {
+		report_part part;
+		part.body      = fopen((filename + ".part").c_str(), "w+b");
+		part.group     = group;
+		part.n_matches = 0;
+		part.n_records = 0;
+		part.binary    = binary;
+		if (part.body == NULL)
+			cout << "Error opening report file " << filename << ".part" << endl;
+		p = parts_.insert(std::make_pair(filename, part)).first;
+	}
+	p->second.n_matches += n_matches;
+	p->second.n_records += n_records;
+	if (p->second.body && fwrite(report.data() + body_start, 1, report.size() - body_start, p->second.body) != report.size() - body_start)
+		cout << "Error writing report file " << filename << ".part" << endl;
+}
+
+void ReportWriter::finish() {
+	//each report is its header with the totals of all batches, followed by the bodies of the batches in order
+	for (std::map<std::string, report_part>::iterator p = parts_.begin(); p != parts_.end(); ++p) {
+		std::string report;
+		char line[64];
+		if (p->second.binary)
+			report_append_header(report, p->second.group, p->second.n_matches, p->second.n_records);
+		else
+			report.append(line, snprintf(line, sizeof(line), "REPORTS: Total matches: %u\n", p->second.n_matches));
+
+		FILE *fp = fopen(p->first.c_str(), "wb");
+		size_t written = 0;
+		if (fp == NULL || p->second.body == NULL)
+			cout << "Error opening report file " << p->first << endl;
+		else {
+			written = fwrite(report.data(), 1, report.size(), fp);
+			rewind(p->second.body);
+			char chunk[65536];
+			size_t n;
+			while ((n = fread(chunk, 1, sizeof(chunk), p->second.body)) > 0)
+				written += fwrite(chunk, 1, n, fp);
+			if (ferror(fp) || ferror(p->second.body))
+				cout << "Error writing report file " << p->first << endl;
+		}
+		if (fp)
+			fclose(fp);
+		if (p->second.body) {
+			fclose(p->second.body);
+			remove((p->first + ".part").c_str());
+		}
+		bytes_written_ += written;
+	}
+	parts_.clear();
+}
+
+void ReportWriter::submit(const std::string &filename, std::string &report) {
+	std::pair<std::string, std::string> job(filename, std::string());
+	job.second.swap(report);
+	queue_.push(job);
+}
+
+void ReportWriter::close() {
+	if (!thread_.joinable())
+		return;
+	std::pair<std::string, std::string> job;//empty file name: no more reports
+	queue_.push(job);
+	thread_.join();
+}
+
+unsigned long long ReportWriter::get_bytes_written() const {
+	return bytes_written_;
+}
+/*------------------------------------------------------------------------------------*/
+static void append_le(std::string &report, uint64_t value, unsigned int n_bytes) {
+	char bytes[8];
+	for (unsigned int b = 0; b < n_bytes; b++)
+		bytes[b] = (char)(value >> (8 * b));
+	report.append(bytes, n_bytes);
+}
+
+void report_append_record(std::string &report, uint64_t off, uint32_t rule) {
+	append_le(report, off, 8);
+	append_le(report, rule, 4);
+}
+
+void report_append_header(std::string &report, uint32_t group, uint32_t n_matches, uint64_t n_records) {
+	append_le(report, REPORT_MAGIC, 4);
+	append_le(report, REPORT_VERSION, 4);
+	append_le(report, group, 4);
+	append_le(report, n_matches, 4);
+	append_le(report, n_records, 8);
+}
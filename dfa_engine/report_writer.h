@@ -0,0 +1,72 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * report_writer Object
+ */
+
+#ifndef REPORT_WRITER_H
+#define REPORT_WRITER_H
+
+#include <string>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "spsc_queue.h"
+
+//binary report (-B 1): one file per DFA group made of a header followed by one record per (match, rule) pair,
+//in the order of the text report; all fields are little-endian. A match whose state has no rule gets a single
+//record with rule REPORT_NO_RULE, so that report_decode can rebuild the text report exactly
+#define REPORT_MAGIC   0x50455244 //"DREP"
+#define REPORT_VERSION 1
+#define REPORT_NO_RULE 0xFFFFFFFF
+
+#define REPORT_HEADER_SIZE 24 //magic, version, group (1-based), matches (uint32 each), records (uint64)
+#define REPORT_RECORD_SIZE 12 //offset in the input file (uint64), rule id (uint32)
+
+//writes report files from a background thread: the reports of the groups are handed over as they are
+//built, so that the disk writes overlap with the scan and with building the next reports. The queue is
+//bounded: a submit waits while REPORT_QUEUE_SIZE reports are not written yet.
+//With batches (-b), every scan of a batch submits the reports of that batch under the same file names:
+//the body of each one is appended to <file>.part and its header counts are added up, and close() writes
+//each file as the header of the totals followed by the bodies of all batches
+#define REPORT_QUEUE_SIZE 8
+
+class ReportWriter {
+	private:
+		typedef struct _report_part{
+			FILE              *body;//<file>.part
+			uint32_t           group;
+			uint32_t           n_matches;
+			uint64_t           n_records;
+			bool               binary;
+		} report_part;
+
+		SpscQueue<std::pair<std::string, std::string> > queue_;//file name, contents; an empty file name stops the thread
+		bool batches_;
+		std::map<std::string, report_part> parts_;//batches: reports under way (writer thread only)
+		std::atomic<unsigned long long> bytes_written_;
+		std::thread thread_;
+
+		void run();
+		void write(const std::string &filename, const std::string &report);
+		void append(const std::string &filename, const std::string &report);
+		void finish();
+
+	public:
+		explicit ReportWriter(bool batches = false);
+		~ReportWriter();
+
+		void submit(const std::string &filename, std::string &report);//takes the contents of report (left empty)
+		void close();//waits until every report submitted is on disk
+		unsigned long long get_bytes_written() const;
+};
+
+//appends one record/the header of a binary report
+void report_append_record(std::string &report, uint64_t off, uint32_t rule);
+void report_append_header(std::string &report, uint32_t group, uint32_t n_matches, uint64_t n_records);
+
+#endif
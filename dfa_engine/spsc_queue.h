@@ -0,0 +1,69 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * spsc_queue Object
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+//bounded queue between two pipeline stages, one thread pushing and one popping: neither side takes a lock.
+//A full queue makes the producer wait, which keeps the work in flight (and the memory it holds) bounded;
+//waiting threads yield for a while, then sleep, so that an idle stage does not take a core from the scan
+template<typename T>
+class SpscQueue {
+	private:
+		std::vector<T> slots_;//one more than the capacity: head_ == tail_ means empty
+		std::atomic<size_t> head_;//next slot to pop, only moved by the consumer
+		std::atomic<size_t> tail_;//next slot to push, only moved by the producer
+
+		static void backoff(unsigned int &spins) {
+			if (++spins < 64)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+
+	public:
+		explicit SpscQueue(size_t capacity) : slots_(capacity + 1), head_(0), tail_(0) {}
+
+		bool try_push(T &item) {//takes the contents of item when it succeeds
+			size_t tail = tail_.load(std::memory_order_relaxed);
+			size_t next = (tail + 1) % slots_.size();
+			if (next == head_.load(std::memory_order_acquire))
+				return false;
+			std::swap(slots_[tail], item);
+			tail_.store(next, std::memory_order_release);
+			return true;
+		}
+
+		bool try_pop(T &item) {
+			size_t head = head_.load(std::memory_order_relaxed);
+			if (head == tail_.load(std::memory_order_acquire))
+				return false;
+			std::swap(item, slots_[head]);
+			head_.store((head + 1) % slots_.size(), std::memory_order_release);
+			return true;
+		}
+
+		void push(T &item) {
+			unsigned int spins = 0;
+			while (!try_push(item))
+				backoff(spins);
+		}
+
+		void pop(T &item) {
+			unsigned int spins = 0;
+			while (!try_pop(item))
+				backoff(spins);
+		}
+};
+
+#endif
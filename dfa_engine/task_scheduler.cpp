@@ -0,0 +1,124 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * task_scheduler.cpp
+ */
+
+#include "task_scheduler.h"
+#include <stdio.h>
+
+using namespace std;
+
+static inline uint64_t make_range(uint32_t begin, uint32_t end) {
+	return ((uint64_t)end << 32) | begin;
+}
+
+static inline double ms_between(chrono::steady_clock::time_point from, chrono::steady_clock::time_point to) {
+	return chrono::duration<double, milli>(to - from).count();
+}
+
+TaskScheduler::TaskScheduler() : slots_(NULL), n_slots_(0), n_threads_(0), n_tasks_(0), next_thread_(0) {
+}
+
+TaskScheduler::~TaskScheduler() {
+	delete [] slots_;
+}
+
+void TaskScheduler::start(unsigned int n_threads, unsigned int n_tasks) {
+	if (n_threads == 0)
+		n_threads = 1;
+	if (n_threads > n_slots_) {
+		delete [] slots_;
+		slots_   = new thread_slot[n_threads];
+		n_slots_ = n_threads;
+	}
+	n_threads_   = n_threads;
+	n_tasks_     = n_tasks;
+	next_thread_ = 0;
+	start_       = clock::now();
+	for (unsigned int t = 0; t < n_threads; t++) {
+		thread_slot &s = slots_[t];
+		s.range  = make_range((uint64_t)n_tasks * t / n_threads, (uint64_t)n_tasks * (t + 1) / n_threads);
+		s.busy   = 0;
+		s.last   = start_;
+		s.finish = start_;
+		s.tasks  = s.stolen = s.steals = 0;
+	}
+}
+
+unsigned int TaskScheduler::attach() {
+	return next_thread_.fetch_add(1);
+}
+
+//takes the back half of the largest range left; the first task of it is returned, the others become the
+//range of the thief (which is empty, so no other thread can be cutting it meanwhile)
+bool TaskScheduler::steal(unsigned int thread, unsigned int *task) {
+	while (1) {
+		unsigned int victim = n_threads_, most = 0;
+		for (unsigned int i = 1; i < n_threads_; i++) {
+			unsigned int v = (thread + i) % n_threads_;
+			uint64_t r = slots_[v].range.load();
+			unsigned int left = (uint32_t)(r >> 32) - (uint32_t)r;
+			if (left > most) {
+				most   = left;
+				victim = v;
+			}
+		}
+		if (victim == n_threads_)
+			return false;
+
+		uint64_t r = slots_[victim].range.load();
+		uint32_t begin = (uint32_t)r, end = (uint32_t)(r >> 32);
+		if (begin >= end)
+			continue;//emptied meanwhile: look again
+		uint32_t cut = end - (end - begin + 1) / 2;
+		if (!slots_[victim].range.compare_exchange_strong(r, make_range(begin, cut)))
+			continue;
+		*task = cut;
+		slots_[thread].range = make_range(cut + 1, end);
+		slots_[thread].stolen += end - cut;
+		slots_[thread].steals++;
+		return true;
+	}
+}
+
+bool TaskScheduler::next(unsigned int thread, unsigned int *task) {
+	thread_slot &s = slots_[thread];
+	clock::time_point now = clock::now();
+	if (s.tasks)
+		s.busy += ms_between(s.last, now);//the previous task is done
+
+	uint64_t r = s.range.load();
+	while ((uint32_t)r < (uint32_t)(r >> 32)) {
+		if (s.range.compare_exchange_weak(r, r + 1)) {//the front task, unless a thief cut it off first
+			*task  = (uint32_t)r;
+			s.last = now;
+			s.tasks++;
+			return true;
+		}
+	}
+	if (steal(thread, task)) {
+		s.last = clock::now();
+		s.tasks++;
+		return true;
+	}
+	s.finish = clock::now();
+	return false;
+}
+
+void TaskScheduler::print_stats(const char *pass) const {
+	clock::time_point end = start_;
+	for (unsigned int t = 0; t < n_threads_; t++)
+		if (slots_[t].finish > end)
+			end = slots_[t].finish;
+	double wall = ms_between(start_, end);
+
+	printf("Scheduler (%s): %u tasks, %u threads, %.3f ms\n", pass, n_tasks_, n_threads_, wall);
+	for (unsigned int t = 0; t < n_threads_; t++) {
+		const thread_slot &s = slots_[t];
+		//idle: starting up, looking for a task to steal and waiting for the last thread of the pass
+		printf("   + thread %u: busy %.3f ms, idle %.3f ms, %u tasks (%u stolen in %u steals)\n",
+		       t, s.busy, wall > s.busy ? wall - s.busy : 0.0, s.tasks, s.stolen, s.steals);
+	}
+}
@@ -0,0 +1,60 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * task_scheduler Object
+ */
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+//work-stealing scheduler of the CPU engine: the tasks of a pass (numbered 0 to n_tasks-1) are dealt out as one
+//contiguous range per thread, so that a thread goes through neighbouring tiles (the same DFA group, consecutive
+//packets) in order. A thread whose range runs out steals the back half of the largest range left, so that
+//threads given the large packets or the large groups are helped by the others instead of holding up the pass.
+//Each range is one 64-bit word: the owner takes tasks from the front and thieves cut from the back, both with a
+//compare-and-swap, so neither takes a lock
+class TaskScheduler {
+	private:
+		typedef std::chrono::steady_clock clock;
+
+		typedef struct _thread_slot{
+			std::atomic<uint64_t> range;//first task in the low 32 bits, end in the high ones
+			double                busy;//ms spent on tasks, only written by the owner
+			clock::time_point     last;//when the owner took its last task
+			clock::time_point     finish;//when the owner found no task left
+			unsigned int          tasks, stolen, steals;
+			char                  pad[64];//keeps the range of the next thread off this cache line
+		} thread_slot;
+
+		thread_slot *slots_;
+		unsigned int n_slots_;
+		unsigned int n_threads_;
+		unsigned int n_tasks_;
+		std::atomic<unsigned int> next_thread_;
+		clock::time_point start_;
+
+		bool steal(unsigned int thread, unsigned int *task);
+
+		TaskScheduler(const TaskScheduler &);
+		TaskScheduler &operator=(const TaskScheduler &);
+	public:
+		TaskScheduler();
+		~TaskScheduler();
+
+		//deals out tasks 0 to n_tasks-1 to n_threads threads, before any of them is started
+		void start(unsigned int n_threads, unsigned int n_tasks);
+		//index of the calling thread for next(), called once by each of the n_threads threads of the pass
+		unsigned int attach();
+		//next task of the thread, stolen from another one if its own range is done; false when no task is left
+		bool next(unsigned int thread, unsigned int *task);
+
+		//busy and idle time of each thread of the pass, once they are all done
+		void print_stats(const char *pass) const;
+};
+
+#endif
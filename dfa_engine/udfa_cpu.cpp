@@ -0,0 +1,166 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * udfa_cpu.cpp
+ */
+
+#include "common.h"
+#include "udfa_cpu.h"
+#include "udfa_simd.h"
+
+//accelerated state at an entry of the table, NULL if it is not one
+static inline const accel_type *udfa_cpu_accel_of(const udfa_cpu_dfa *dfa, state_t entry){
+	unsigned int k = dfa->accel_index[dfa->row_stride == 1 ? entry / dfa->alphabet_size : entry];
+	return k ? &dfa->accel[k-1] : NULL;
+}
+
+//one instance per entry width and encoding: with row offsets (ROW_OFFSETS) a step is a single add and load
+template<typename T, bool ROW_OFFSETS>
+static void udfa_cpu_kernel_width(
+				const T *dfa_state_table, const symbol *alphabet_tx, unsigned int row_stride, state_t accept_offset, state_t dead_state,
+				const udfa_cpu_dfa *dfa,
+				const symbol *input, unsigned int cur_pkt_size, state_t *start_state,
+				unsigned int *match_count, match_type *match_array, unsigned int match_vec_size){
+
+	unsigned int shr_match_count = 0;
+	match_type tmp_match;
+
+	state_t current_state = *start_state;
+	bool    accel         = (dfa->accel_index != NULL);
+	state_t plain_state   = -1;//last state that looped on itself and turned out not to be accelerated
+
+	//loop over payload (padding bytes included, as in udfa_kernel)
+	for(unsigned int p=0; p<cur_pkt_size; p++){
+		state_t prev_state = current_state;
+		//query the state table on the input symbol for the next state
+		current_state = dfa_state_table[(ROW_OFFSETS ? current_state : current_state * row_stride) + alphabet_tx[input[p]]];
+
+		if (current_state >= accept_offset) {//check if the dst state is an accepting state
+			if (shr_match_count < match_vec_size) {//never write past this cell's slice of the match array, but keep counting
+				tmp_match.off  = p;
+				tmp_match.stat = current_state;
+				match_array[shr_match_count] = tmp_match;
+			}
+			shr_match_count = shr_match_count + 1;
+		}
+		else if (current_state == dead_state)//never left and never accepting: the rest of the packet cannot match
+			break;
+		else if (accel && current_state == prev_state && current_state != plain_state) {
+			//in a self-loop: if only a few symbols leave this state, jump to the next of them (nothing matches on the way)
+			const accel_type *a = udfa_cpu_accel_of(dfa, current_state);
+			if (a)
+				p = udfa_cpu_accel_skip(a, input, p + 1, cur_pkt_size) - 1;
+			else
+				plain_state = current_state;
+		}
+	}
+	*start_state = current_state;
+	*match_count = shr_match_count;
+}
+
+template<typename T>
+static void udfa_cpu_kernel_encoding(
+				const udfa_cpu_dfa *dfa,
+				const symbol *input, unsigned int cur_pkt_size, state_t *current_state,
+				unsigned int *match_count, match_type *match_array, unsigned int match_vec_size){
+	if (dfa->row_stride == 1)
+		udfa_cpu_kernel_width<T, true>((const T *)dfa->state_table, dfa->alphabet_tx, 1, dfa->accept_offset, dfa->dead_state, dfa,
+		                               input, cur_pkt_size, current_state, match_count, match_array, match_vec_size);
+	else
+		udfa_cpu_kernel_width<T, false>((const T *)dfa->state_table, dfa->alphabet_tx, dfa->row_stride, dfa->accept_offset, dfa->dead_state, dfa,
+		                                input, cur_pkt_size, current_state, match_count, match_array, match_vec_size);
+}
+
+void udfa_cpu_kernel(
+				const udfa_cpu_dfa *dfa,
+				const symbol *input, unsigned int cur_pkt_size, state_t *current_state,
+				unsigned int *match_count, match_type *match_array, unsigned int match_vec_size){
+	switch (dfa->state_width) {
+		case 1:  udfa_cpu_kernel_encoding<uint8_t>(dfa, input, cur_pkt_size, current_state, match_count, match_array, match_vec_size); break;
+		case 2:  udfa_cpu_kernel_encoding<uint16_t>(dfa, input, cur_pkt_size, current_state, match_count, match_array, match_vec_size); break;
+		default: udfa_cpu_kernel_encoding<state_t>(dfa, input, cur_pkt_size, current_state, match_count, match_array, match_vec_size); break;
+	}
+}
+
+unsigned int udfa_cpu_kernel_fixup(
+				const udfa_cpu_dfa *dfa,
+				const symbol *input, unsigned int cur_pkt_size, state_t *current_state, state_t spec_state,
+				unsigned int *match_count, match_type *match_array, unsigned int match_vec_size){
+
+	unsigned int shr_match_count = 0;
+	match_type tmp_match;
+
+	state_t true_state = *current_state;
+	unsigned int p;
+	for (p = 0; p < cur_pkt_size && true_state != spec_state; p++) {
+		size_t column = dfa->alphabet_tx[input[p]];
+		true_state = udfa_cpu_entry(dfa->state_table, dfa->state_width, true_state * dfa->row_stride + column);
+		spec_state = udfa_cpu_entry(dfa->state_table, dfa->state_width, spec_state * dfa->row_stride + column);
+
+		if (true_state >= (state_t)dfa->accept_offset) {//check if the dst state is an accepting state
+			if (shr_match_count < match_vec_size) {
+				tmp_match.off  = p;
+				tmp_match.stat = true_state;
+				match_array[shr_match_count] = tmp_match;
+			}
+			shr_match_count = shr_match_count + 1;
+		}
+		else if (true_state == dfa->dead_state) {//no match left in the packet: none of the speculative ones stands
+			p = cur_pkt_size;
+			break;
+		}
+	}
+	*current_state = true_state;
+	*match_count   = shr_match_count;
+	return p;
+}
+
+void udfa_cpu_kernel_interleaved(udfa_cpu_stream *streams, unsigned int n_streams, unsigned int n_steps){
+
+	const void    *tables[CPU_MAX_INTERLEAVE];
+	unsigned int   state_widths[CPU_MAX_INTERLEAVE];
+	unsigned int   exts[CPU_MAX_INTERLEAVE];
+	const symbol  *txs[CPU_MAX_INTERLEAVE];
+	unsigned int   row_strides[CPU_MAX_INTERLEAVE];
+	state_t        accept_offsets[CPU_MAX_INTERLEAVE];
+	const symbol  *inputs[CPU_MAX_INTERLEAVE];
+	state_t        states[CPU_MAX_INTERLEAVE];
+	match_type tmp_match;
+
+	for (unsigned int i = 0; i < n_streams; i++) {
+		tables[i]         = streams[i].dfa->state_table;
+		state_widths[i]   = streams[i].dfa->state_width;
+		exts[i]           = 32 - 8*state_widths[i];
+		txs[i]            = streams[i].dfa->alphabet_tx;
+		row_strides[i]    = streams[i].dfa->row_stride;
+		accept_offsets[i] = streams[i].dfa->accept_offset;
+		inputs[i]         = streams[i].input + streams[i].p;
+		states[i]         = streams[i].current_state;
+	}
+
+	for (unsigned int step = 0; step < n_steps; step++) {
+		for (unsigned int i = 0; i < n_streams; i++) {
+			state_t current_state = udfa_cpu_entry_word(tables[i], state_widths[i], exts[i], states[i] * row_strides[i] + txs[i][inputs[i][step]]);
+
+			if (current_state >= accept_offsets[i]) {//check if the dst state is an accepting state
+				if (streams[i].shr_match_count < streams[i].match_vec_size) {
+					tmp_match.off  = streams[i].p + step;
+					tmp_match.stat = current_state;
+					streams[i].match_array[streams[i].shr_match_count] = tmp_match;
+				}
+				streams[i].shr_match_count++;
+			}
+			states[i] = current_state;
+
+			//the next byte is known already: start fetching the entry it selects while the other streams run
+			if (step + 1 < n_steps)
+				__builtin_prefetch((const char *)tables[i] + (size_t)(current_state * row_strides[i] + txs[i][inputs[i][step + 1]]) * state_widths[i]);
+		}
+	}
+
+	for (unsigned int i = 0; i < n_streams; i++) {
+		streams[i].p += n_steps;
+		streams[i].current_state = states[i];
+	}
+}
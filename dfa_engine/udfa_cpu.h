@@ -0,0 +1,89 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * UDFA CPU Object
+ */
+
+#ifndef UDFA_CPU_H
+#define UDFA_CPU_H
+
+#include <stdint.h>
+#include "common.h"
+
+//state table of one DFA group as the CPU kernels see it: rows have alphabet_size entries of
+//state_width bytes (uint8_t, uint16_t or state_t), indexed by the class alphabet_tx[symbol] of the
+//input symbol; one step is entry = table[entry * row_stride + column], where row_stride is 1 when
+//the entries are pre-multiplied row offsets and alphabet_size when they are state ids. The start
+//state is entry 0 and entries >= accept_offset lead to accepting states; dead_state is the entry of the
+//non-accepting state that only leads to itself (-1 if the DFA has none), from which nothing can match any more.
+//accel_index (NULL if the DFA has no accelerated states) gives for each state id 1 + the index of its escape
+//symbols in accel, or 0; the state id of an entry is entry / alphabet_size with row offsets, the entry otherwise
+typedef struct _udfa_cpu_dfa{
+	const void    *state_table;
+	unsigned int   state_width;
+	const symbol  *alphabet_tx;
+	unsigned int   alphabet_size;
+	unsigned int   row_stride;
+	unsigned int   accept_offset;
+	state_t        dead_state;
+	const accel_type   *accel;
+	const unsigned int *accel_index;
+} udfa_cpu_dfa;
+
+//entry idx of the state table, widened to 32 bits
+static inline state_t udfa_cpu_entry(const void *state_table, unsigned int state_width, size_t idx){
+	switch (state_width) {
+		case 1:  return ((const uint8_t *)state_table)[idx];
+		case 2:  return ((const uint16_t *)state_table)[idx];
+		default: return ((const state_t *)state_table)[idx];
+	}
+}
+
+//branch-free variant for kernels that mix widths: loads the 32-bit word at the entry and keeps its low
+//state_width bytes (ext = 32 - 8*state_width); narrow tables are followed by sizeof(state_t) spare
+//bytes, so the word never crosses the end of the allocation
+static inline state_t udfa_cpu_entry_word(const void *state_table, unsigned int state_width, unsigned int ext, size_t idx){
+	unsigned int word;
+	memcpy(&word, (const char *)state_table + idx * state_width, sizeof(word));
+	return (state_t)((word << ext) >> ext);
+}
+
+//CPU counterpart of udfa_kernel: one call processes one (packet, DFA) cell of the packets x DFAs grid,
+//starting from the entry *current_state (0 - start state) and leaving there the entry after the last byte.
+//*match_count receives the number of matches found, of which only the first match_vec_size are stored
+//(this holds for all CPU kernels, so that a caller can detect an overflow and rescan with a larger array).
+//The scan stops at the dead state, which is then the entry left in *current_state, and skips the bytes that an
+//accelerated state loops on
+void udfa_cpu_kernel(
+				const udfa_cpu_dfa *dfa,
+				const symbol *input, unsigned int cur_pkt_size, state_t *current_state,
+				unsigned int *match_count, match_type *match_array, unsigned int match_vec_size);
+
+//fix-up step of speculative scanning: rescans input from the entry *current_state next to the speculative run that
+//started from spec_state, until both runs reach the same entry (from there on the speculative run was right).
+//Returns the number of bytes rescanned (cur_pkt_size if the runs never meet or the rescan reaches the dead state); the matches of the rescan are stored
+//like udfa_cpu_kernel does and its last entry is left in *current_state
+unsigned int udfa_cpu_kernel_fixup(
+				const udfa_cpu_dfa *dfa,
+				const symbol *input, unsigned int cur_pkt_size, state_t *current_state, state_t spec_state,
+				unsigned int *match_count, match_type *match_array, unsigned int match_vec_size);
+
+//one (packet, DFA) cell in flight in the interleaved kernel
+typedef struct _udfa_cpu_stream{
+	const udfa_cpu_dfa *dfa;
+	const symbol  *input;
+	unsigned int   cur_pkt_size;
+	unsigned int   p;//next byte of the packet to be consumed
+	state_t        current_state;
+	unsigned int   shr_match_count;
+	unsigned int  *match_count;//this cell's entry of the match count array, written when the cell is done
+	match_type    *match_array;//this cell's slice of the match array
+	unsigned int   match_vec_size;//room of match_array
+} udfa_cpu_stream;
+
+//advances n_streams (<= CPU_MAX_INTERLEAVE) independent cells by n_steps bytes each, in lockstep,
+//so that the table lookups of different cells are in flight at the same time;
+//each stream must have at least n_steps bytes left
+void udfa_cpu_kernel_interleaved(udfa_cpu_stream *streams, unsigned int n_streams, unsigned int n_steps);
+#endif
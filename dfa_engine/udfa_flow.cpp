@@ -0,0 +1,66 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * udfa_flow.cpp
+ */
+
+#include "common.h"
+#include "udfa_flow.h"
+
+void udfa_flow_engine_init(udfa_flow_engine *engine, const std::vector<FiniteAutomaton *> &fa){
+	engine->dfas.resize(fa.size());
+	engine->state_pos.resize(fa.size());
+	engine->state_size = sizeof(uint64_t);
+	for (unsigned int i = 0; i < fa.size(); i++) {
+		engine->dfas[i].state_table   = fa[i]->get_state_table();
+		engine->dfas[i].state_width   = fa[i]->get_state_width();
+		engine->dfas[i].alphabet_tx   = fa[i]->get_alphabet_tx();
+		engine->dfas[i].alphabet_size = fa[i]->get_alphabet_size();
+		engine->dfas[i].row_stride    = fa[i]->get_row_stride();
+		engine->dfas[i].accept_offset = fa[i]->get_accept_offset();
+		engine->dfas[i].dead_state    = fa[i]->get_dead_state();
+		engine->dfas[i].accel         = fa[i]->get_accel();
+		engine->dfas[i].accel_index   = fa[i]->get_accel_index();
+		//every entry of a table fits in its entry width, so the current entry does too
+		engine->state_pos[i] = engine->state_size;
+		engine->state_size  += engine->dfas[i].state_width;
+	}
+}
+
+unsigned int udfa_flow_state_size(const udfa_flow_engine *engine){
+	return engine->state_size;
+}
+
+void udfa_flow_state_init(const udfa_flow_engine *engine, void *flow_state){
+	memset(flow_state, 0, engine->state_size);//offset 0 and entry 0 (the start state) in every group
+}
+
+uint64_t udfa_flow_offset(const void *flow_state){
+	uint64_t offset;
+	memcpy(&offset, flow_state, sizeof(offset));
+	return offset;
+}
+
+void udfa_flow_scan(const udfa_flow_engine *engine, void *flow_state,
+				const symbol *chunk, unsigned int chunk_size,
+				unsigned int *match_count, match_type *match_array, unsigned int match_vec_size){
+	char *blob = (char *)flow_state;
+
+	for (unsigned int i = 0; i < engine->dfas.size(); i++) {
+		//blobs have no alignment, entries are copied in and out at their table width
+		unsigned int width = engine->dfas[i].state_width;
+		uint32_t entry = 0;
+		memcpy(&entry, blob + engine->state_pos[i], width);//little-endian: the low bytes of the entry
+		state_t current_state = (state_t)entry;
+
+		udfa_cpu_kernel(&engine->dfas[i], chunk, chunk_size, &current_state,
+		                &match_count[i], &match_array[(size_t)match_vec_size*i], match_vec_size);
+
+		entry = (uint32_t)current_state;
+		memcpy(blob + engine->state_pos[i], &entry, width);
+	}
+
+	uint64_t offset = udfa_flow_offset(flow_state) + chunk_size;
+	memcpy(blob, &offset, sizeof(offset));
+}
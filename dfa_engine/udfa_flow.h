@@ -0,0 +1,47 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * UDFA flow Object
+ */
+
+#ifndef UDFA_FLOW_H
+#define UDFA_FLOW_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "common.h"
+#include "common_configs.h"
+#include "finite_automaton.h"
+#include "udfa_cpu.h"
+
+//DFA groups prepared for input that arrives in pieces, e.g. the segments of many TCP flows: each flow keeps its
+//scan state in a blob of udfa_flow_state_size() bytes owned by the caller, which holds the running input offset
+//followed by the current entry of every group at the width of its state table. Blobs are plain bytes, so they can
+//be copied with memcpy, stored in any container and moved between threads; the engine itself is read-only once
+//initialized and can be shared by all threads
+typedef struct _udfa_flow_engine{
+	std::vector<udfa_cpu_dfa>  dfas;
+	std::vector<unsigned int>  state_pos;//byte position of the entry of each group in a blob
+	unsigned int               state_size;//bytes of a blob
+} udfa_flow_engine;
+
+void udfa_flow_engine_init(udfa_flow_engine *engine, const std::vector<FiniteAutomaton *> &fa);
+
+unsigned int udfa_flow_state_size(const udfa_flow_engine *engine);
+
+//state of a flow that has not seen any input: offset 0, every group in its start state
+void udfa_flow_state_init(const udfa_flow_engine *engine, void *flow_state);
+
+//number of input bytes the flow has been fed so far
+uint64_t udfa_flow_offset(const void *flow_state);
+
+//scans the next chunk of a flow with every group, resuming from flow_state and updating it.
+//The matches of group i are match_array[match_vec_size*i .. match_vec_size*i + match_count[i] - 1], with offsets
+//relative to the chunk (the flow offset of a match is udfa_flow_offset() before the call plus .off); rules are
+//looked up with FiniteAutomaton::get_rules(.stat, &n_rules). At most match_vec_size matches per group are kept
+void udfa_flow_scan(const udfa_flow_engine *engine, void *flow_state,
+				const symbol *chunk, unsigned int chunk_size,
+				unsigned int *match_count, match_type *match_array, unsigned int match_vec_size);
+#endif
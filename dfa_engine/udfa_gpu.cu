@@ -13,7 +13,7 @@ __global__ void udfa_kernel(
 				symboln *input,
 				unsigned int *pkt_size_vec, unsigned int pkt_size,
 				unsigned int *match_count, match_type *match_array, unsigned int match_vec_size,
-				unsigned int *accum_dfa_state_table_lengths, unsigned int n_subsets){					
+				unsigned int *accum_dfa_state_table_lengths, state_t *dead_states, unsigned int n_subsets){					
 	
 	unsigned int dfa_id = threadIdx.x + blockIdx.y * blockDim.x;
 	match_type tmp_match;
@@ -30,6 +30,7 @@ __global__ void udfa_kernel(
 	input += (pkt_size * blockIdx.x/fetch_bytes); 
 
 	unsigned int accum_dfa_state_table_length = accum_dfa_state_table_lengths[dfa_id];
+	state_t dead_state = dead_states[dfa_id];//-1 if the DFA has none
 	
 	state_t current_state = 0;
 
@@ -49,11 +50,14 @@ __global__ void udfa_kernel(
 				//match_states[match_vec_size*blockIdx.x + shr_match_count + dfa_id*match_vec_size*nstreams] = current_state;
 				tmp_match.off  = p + byt;
 				tmp_match.stat = current_state;
-				match_array[shr_match_count + match_vec_size*(blockIdx.x + dfa_id*gridDim.x)] = tmp_match;
+				if (shr_match_count < match_vec_size)//full: keep counting so that the host can tell how many were dropped
+					match_array[shr_match_count + match_vec_size*(blockIdx.x + dfa_id*gridDim.x)] = tmp_match;
 				
 				shr_match_count = shr_match_count + 1;
 			}		
 		}
+		if (current_state == dead_state)//the rest of the packet cannot match
+			break;
 	}
 	match_count[blockIdx.x + dfa_id*gridDim.x] = shr_match_count;
 }
@@ -16,5 +16,5 @@ __global__ void udfa_kernel(
 				symboln *input,
 				unsigned int *pkt_size_vec, unsigned int pkt_size,
 				unsigned int *match_count, match_type *match_array, unsigned int match_vec_size,
-				unsigned int *accum_dfa_state_table_lengths, unsigned int n_subsets);
+				unsigned int *accum_dfa_state_table_lengths, state_t *dead_states, unsigned int n_subsets);
 #endif
@@ -24,6 +24,7 @@
 #include "mem_controller.h"
 #include "udfa_host.h"
 #include "udfa_gpu.h"
+#include "report_writer.h"
 				
 using namespace std;
 
@@ -35,7 +36,7 @@ texture<state_t, cudaTextureType1D, cudaReadModeElementType> tex_dfa_state_table
 __global__ void udfa_kernel_texture(symboln *input,
 									unsigned int *pkt_size_vec, unsigned int pkt_size,
 									unsigned int *match_count, match_type *match_array, unsigned int match_vec_size,
-									unsigned int *accum_dfa_state_table_lengths, unsigned int n_subsets);
+									unsigned int *accum_dfa_state_table_lengths, state_t *dead_states, unsigned int n_subsets);
 #endif
 /*--------------------------------------------------------------------------------------------------*/
 void GPUMemInfo() {
@@ -53,14 +54,14 @@ void GPUMemInfo() {
    printf("GPU memory usage: used = %lf MB, free = %lf MB, total = %f MB\n", used_db/1024.0/1024.0, free_db/1024.0/1024.0, total_db/1024.0/1024.0);
 }
 /*--------------------------------------------------------------------------------------------------*/
-unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsigned int n_subsets, unsigned int packet_size, int *rulestartvec, double *t_alloc, double *t_kernel, double *t_collect, double *t_free, int *blocksize, int blksiz_tuning){
+unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsigned int n_subsets, unsigned int packet_size, int *rulestartvec, ReportWriter &writer, double *t_alloc, double *t_kernel, double *t_collect, double *t_free, int *blocksize, int blksiz_tuning){
 
     struct timeval c0, c1, c2, c3, c33, c4;
     long seconds, useconds;
     unsigned int *h_match_count, *d_match_count;
     match_type   *h_match_array, *d_match_array;
    
-    ofstream fp_report;
+    std::string report;
     char filename[200], bufftmp[10];
    
     state_t *d_dfa_state_tables;
@@ -69,6 +70,7 @@ unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsig
     size_t max_shmem=0;
     unsigned int   *accum_dfa_state_table_lengths;//Note: arrays contain accumulated values
     unsigned int *d_accum_dfa_state_table_lengths;
+    state_t      *dead_states, *d_dead_states;//per DFA: state id of the dead state, -1 if none
    
 	/*cout << "------------- Preparing to launch kernel ---------------" << endl;
 	cout << "Packets (Streams or Number of CUDA blocks in x-dimension): " << packets.get_payload_sizes().size() << endl;
@@ -88,7 +90,7 @@ unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsig
     
 	gettimeofday(&c0, NULL);
 
-	unsigned int tmp_avg_count = packets.get_payload_sizes()[0]*15/n_subsets;//just for now, size of each match array for each packet//????????
+	unsigned int tmp_avg_count = packet_size*15/n_subsets;//just for now, size of each match array for each packet//????????
 	
 	cout << "tmp_avg_count: "   << tmp_avg_count
          << ", n_packets: "     << packets.get_payload_sizes().size() 
@@ -98,10 +100,12 @@ unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsig
 	h_match_array         = (match_type*)malloc ((tmp_avg_count*packets.get_payload_sizes().size()) * n_subsets * sizeof(match_type));//just for now
     h_match_count         = (unsigned int*)malloc ((              packets.get_payload_sizes().size()) * n_subsets * sizeof(unsigned int));//just for now  
     accum_dfa_state_table_lengths = (unsigned int*)malloc (n_subsets * sizeof(unsigned int));
+    dead_states                   = (state_t*)malloc (n_subsets * sizeof(state_t));
 			
 	cudaMalloc( (void **) &d_match_array,  (tmp_avg_count*packets.get_payload_sizes().size()) * n_subsets * sizeof(match_type));//just for now
     cudaMalloc( (void **) &d_match_count,  (              packets.get_payload_sizes().size()) * n_subsets * sizeof(unsigned int));//just for now
 	cudaMalloc( (void **) &d_accum_dfa_state_table_lengths, n_subsets * sizeof(unsigned int));
+	cudaMalloc( (void **) &d_dead_states, n_subsets * sizeof(state_t));
     	
 	size_t tmp_dfa_state_table_total_size=0, tmp_curr_dfa_state_table_size=0, tmp_accum_prev_dfa_state_table_size=0;//in bytes
 	for (unsigned int i = 0; i < n_subsets; i++) {//Find total size (in bytes) of each data structure
@@ -110,7 +114,7 @@ unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsig
 	
 	//Allocate device memory
 	cudaMalloc((void **) &d_dfa_state_tables, tmp_dfa_state_table_total_size);
-    cudaMalloc((void **) &d_input, packets.get_payloads().size() * sizeof(*d_input));
+    cudaMalloc((void **) &d_input, (size_t)packet_size * packets.get_payload_sizes().size() * sizeof(*d_input));
     cudaMalloc((void **) &d_pkt_size, packets.get_payload_sizes().size() * sizeof(*d_pkt_size));
 	
 	for (unsigned int i = 0; i < n_subsets; i++){//Copy to device memory
@@ -125,17 +129,25 @@ unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsig
 			retval3 = cudaMemcpy( &d_dfa_state_tables[tmp_accum_prev_dfa_state_table_size/sizeof(state_t)], fa[i]->get_dfa_state_table(), tmp_curr_dfa_state_table_size, cudaMemcpyHostToDevice);
 		}
 		accum_dfa_state_table_lengths[i] = tmp_accum_prev_dfa_state_table_size/sizeof(state_t);
+		dead_states[i]                   = fa[i]->get_dead_state();
 	
 		if (retval3 != cudaSuccess) cout << "Error while copying dfa state table to device memory" << endl;
 	}
 
-    cudaError_t retval = cudaMemcpy(d_input, &(packets.get_payloads()[0]), packets.get_payloads().size() * sizeof(*d_input), cudaMemcpyHostToDevice);
+    //the kernels find packet j at j*packet_size, each one padded with zeros up to it: staged once, from the views of the
+    //mapped input (the payloads of a capture have different sizes, so packet_size is the largest one)
+    size_t input_size = (size_t)packet_size * packets.get_payload_sizes().size();
+    symbol *h_input = (symbol*)malloc (input_size * sizeof(symbol));
+    packets.copy_packets(h_input, packet_size);
+    cudaError_t retval = cudaMemcpy(d_input, h_input, input_size * sizeof(*d_input), cudaMemcpyHostToDevice);
     if (retval != cudaSuccess) cout << "Error while copying payload to device memory" << endl;
+    free(h_input);
 	
     retval = cudaMemcpy(d_pkt_size, &(packets.get_payload_sizes()[0]), packets.get_payload_sizes().size() * sizeof(*d_pkt_size), cudaMemcpyHostToDevice);
 	if (retval != cudaSuccess) cout << "Error while copying packet sizes to device memory" << endl;
 	
 	cudaMemcpy( d_accum_dfa_state_table_lengths, accum_dfa_state_table_lengths,    n_subsets * sizeof(unsigned int), cudaMemcpyHostToDevice);
+	cudaMemcpy( d_dead_states,                   dead_states,                      n_subsets * sizeof(state_t),      cudaMemcpyHostToDevice);
 			
 	GPUMemInfo();
 	
@@ -196,14 +208,14 @@ unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsig
                                         (symboln*)d_input,
                                         d_pkt_size, packet_size,
                                         d_match_count, d_match_array, tmp_avg_count,
-                                        d_accum_dfa_state_table_lengths, n_subsets);
+                                        d_accum_dfa_state_table_lengths, d_dead_states, n_subsets);
 #else
 	printf("Store DFA STATE TABLE in global memory!\n");
     udfa_kernel<<<grid, block>>>(d_dfa_state_tables,
                                 (symboln*)d_input,
                                 d_pkt_size, packet_size,
                                 d_match_count, d_match_array, tmp_avg_count,
-                                d_accum_dfa_state_table_lengths, n_subsets);							    
+                                d_accum_dfa_state_table_lengths, d_dead_states, n_subsets);							    
 #endif
 				
 	cudaThreadSynchronize();
@@ -223,26 +235,43 @@ unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsig
 	// Collect results
 	//Temporarily comment the following FOR loop
 	unsigned int total_matches=0;
-	for (unsigned int i = 0; i < n_subsets; i++) {
+	unsigned long long dropped_matches=0;
+	unsigned int n_packets = packets.get_payload_sizes().size();
+	for (unsigned int c = 0; c < n_packets * n_subsets; c++) {//counts include the matches that did not fit
+		unsigned int kept = h_match_count[c] < tmp_avg_count ? h_match_count[c] : tmp_avg_count;
+		if (cfg.get_max_matches() && kept > cfg.get_max_matches()) kept = cfg.get_max_matches();
+		dropped_matches += h_match_count[c] - kept;
+		h_match_count[c] = kept;
+	}
+	std::vector<const match_type *> cell_matches(n_packets * n_subsets);//same layout as the grid
+	for (unsigned int c = 0; c < n_packets * n_subsets; c++)
+		cell_matches[c] = &h_match_array[(size_t)tmp_avg_count*c];
 #ifdef TEXTURE_MEM_USE
-        strcpy (filename,"Report_tex_");
+	strcpy (filename,"Report_tex_");
 #else
-        strcpy (filename,"Report_global_");
+	strcpy (filename,"Report_global_");
 #endif
-		snprintf(bufftmp, sizeof(bufftmp),"%d",n_subsets);
-		strcat (filename,bufftmp);
-		strcat (filename,"_");
-		snprintf(bufftmp, sizeof(bufftmp),"%d",i+1);
-		strcat (filename,bufftmp);
-		strcat (filename,".txt");
-		fp_report.open (filename); //cout << "Report filename:" << filename << endl;
-		fa[i]->mapping_states2rules(&h_match_count[packets.get_payload_sizes().size()*i], &h_match_array[tmp_avg_count*packets.get_payload_sizes().size()*i], 
-		                            tmp_avg_count, packets.get_payload_sizes(), packets.get_padded_sizes(), fp_report, rulestartvec, i);
-		fp_report.close();
-		for (unsigned int j = 0; j < packets.get_payload_sizes().size(); j++)
-			total_matches += h_match_count[j + packets.get_payload_sizes().size()*i];		
+	snprintf(bufftmp, sizeof(bufftmp),"%d",n_subsets);
+	strcat (filename,bufftmp);
+	if (cfg.get_merge_reports()) {//one report, all groups merged in offset order
+		strcat (filename,cfg.get_report_format() == 1 ? ".bin" : ".txt");
+		total_matches = merge_states2rules(fa, &h_match_count[0], &cell_matches[0], packets, report, cfg.get_report_format(), rulestartvec);
+		writer.submit(filename, report);
+	}
+	else {
+		size_t prefix_len = strlen(filename);
+		for (unsigned int i = 0; i < n_subsets; i++) {
+			filename[prefix_len] = '\0';
+			strcat (filename,"_");
+			snprintf(bufftmp, sizeof(bufftmp),"%d",i+1);
+			strcat (filename,bufftmp);
+			strcat (filename,cfg.get_report_format() == 1 ? ".bin" : ".txt");
+			total_matches += fa[i]->mapping_states2rules(&h_match_count[n_packets*i], &cell_matches[n_packets*i], packets, report, cfg.get_report_format(), rulestartvec, i);
+			writer.submit(filename, report); //cout << "Report filename:" << filename << endl;
+		}
 	}
 	printf("Host - Total number of matches %d\n", total_matches);
+	printf("Host - Matches dropped %llu\n", dropped_matches);
 
     gettimeofday(&c33, NULL);
 	
@@ -250,6 +279,7 @@ unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsig
 	cudaFree(d_match_count);
 	cudaFree(d_match_array);
 	cudaFree(d_accum_dfa_state_table_lengths);
+	cudaFree(d_dead_states);
 	cudaFree(d_dfa_state_tables);
 	cudaFree(d_input);
     cudaFree(d_pkt_size);
@@ -257,6 +287,7 @@ unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsig
 	free(h_match_count);
     free(h_match_array);
 	free(accum_dfa_state_table_lengths);
+	free(dead_states);
 		
 	gettimeofday(&c4, NULL);
 	
@@ -280,14 +311,14 @@ unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsig
 	useconds = c33.tv_usec - c3.tv_usec;
 	printf("host_functions.cu: t_postprocesscpu= %lf(ms)\n", ((double)seconds * 1000 + (double)useconds/1000.0));
 	
-	return 0;
+	return total_matches;
 }
 /*--------------------------------------------------------------------------------------------------*/
 #ifdef TEXTURE_MEM_USE
 __global__ void udfa_kernel_texture(symboln *input,
 									unsigned int *pkt_size_vec, unsigned int pkt_size,
 									unsigned int *match_count, match_type *match_array, unsigned int match_vec_size,
-									unsigned int *accum_dfa_state_table_lengths, unsigned int n_subsets){					
+									unsigned int *accum_dfa_state_table_lengths, state_t *dead_states, unsigned int n_subsets){					
 	
 	unsigned int dfa_id = threadIdx.x + blockIdx.y * blockDim.x;
 	match_type tmp_match;
@@ -304,6 +335,7 @@ __global__ void udfa_kernel_texture(symboln *input,
 	input += (pkt_size * blockIdx.x/fetch_bytes); 
 
 	unsigned int accum_dfa_state_table_length = accum_dfa_state_table_lengths[dfa_id];
+	state_t dead_state = dead_states[dfa_id];//-1 if the DFA has none
 	
 	state_t current_state = 0;
 
@@ -323,11 +355,14 @@ __global__ void udfa_kernel_texture(symboln *input,
 				//match_states[match_vec_size*blockIdx.x + shr_match_count + dfa_id*match_vec_size*gridDim.x] = current_state;
 				tmp_match.off  = p + byt;
 				tmp_match.stat = current_state;
-				match_array[shr_match_count + match_vec_size*(blockIdx.x + dfa_id*gridDim.x)] = tmp_match;
+				if (shr_match_count < match_vec_size)//full: keep counting so that the host can tell how many were dropped
+					match_array[shr_match_count + match_vec_size*(blockIdx.x + dfa_id*gridDim.x)] = tmp_match;
 				
 				shr_match_count = shr_match_count + 1;			
 			}
 		}
+		if (current_state == dead_state)//the rest of the packet cannot match
+			break;
 	}
 	match_count[blockIdx.x + dfa_id*gridDim.x] = shr_match_count;
 }
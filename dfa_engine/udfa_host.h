@@ -18,7 +18,17 @@
 #include "finite_automaton.h"
 
 class Packets;
+class ReportWriter;
+class PcapReader;
  
-unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsigned int n_subsets, unsigned int packet_size, int *rulestartvec, double *t_alloc, double *t_kernel, double *t_collect, double *t_free, int *blocksize, int blksiz_tuning);
+//packet_size is the largest packet, padding included (packets.get_max_payload_size()); the reports are handed to writer,
+//which the caller closes once every batch of packets is scanned; returns the number of matches
+unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsigned int n_subsets, unsigned int packet_size, int *rulestartvec, ReportWriter &writer, double *t_alloc, double *t_kernel, double *t_collect, double *t_free, int *blocksize, int blksiz_tuning);
+
+#ifdef CPU_ONLY
+//-F: scans the TCP streams (reassembled) and UDP flows of the capture mapped by packets, every flow resuming from
+//its own DFA states; reports and return value as udfa_run, with match offsets in the capture file
+unsigned int udfa_run_flows(std::vector<FiniteAutomaton *> fa, Packets &packets, PcapReader &capture, unsigned int n_subsets, int *rulestartvec, ReportWriter &writer, double *t_kernel);
+#endif
 
 #endif
@@ -0,0 +1,1077 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * udfa_host_cpu.cpp
+ *
+ * CPU-only implementation of udfa_run: the packets x DFAs grid launched by udfa_kernel
+ * is executed by a pool of host threads. Matches are kept in per-thread buffers that grow
+ * as needed and are handed to FiniteAutomaton::mapping_states2rules cell by cell, so that
+ * reports are identical to the GPU ones.
+ */
+
+#include <cstdlib>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "packets.h"
+#include "common.h"
+#include "mem_controller.h"
+#include "udfa_host.h"
+#include "udfa_cpu.h"
+#include "udfa_simd.h"
+#include "report_writer.h"
+#include "spsc_queue.h"
+#include "pcap_reader.h"
+#include "flow_table.h"
+#include "udfa_flow.h"
+#include "task_scheduler.h"
+
+using namespace std;
+
+extern CommonConfigs cfg;
+
+/*--------------------------------------------------------------------------------------------------*/
+//matches of one worker thread: the matches of a cell are appended when the cell is done, so the buffer grows
+//with the matches actually found instead of being sized for the worst case up front. It grows by adding blocks
+//of doubling size, which never move, so that the report thread can read finished cells while the worker goes on
+typedef struct _udfa_cpu_match_block{
+	match_type                   *matches;
+	size_t                        n_matches;
+	size_t                        capacity;
+	struct _udfa_cpu_match_block *prev;
+} udfa_cpu_match_block;
+
+//room for n more matches at the end of the last block of *buf, NULL if no block can be allocated
+static match_type *match_buffer_reserve(udfa_cpu_match_block **buf, size_t n){
+	udfa_cpu_match_block *last = *buf;
+	if (last == NULL || last->n_matches + n > last->capacity) {
+		size_t capacity = last ? 2 * last->capacity : CPU_MATCH_VEC_SIZE;
+		while (capacity < n)
+			capacity *= 2;
+		udfa_cpu_match_block *block = (udfa_cpu_match_block*)malloc(sizeof(udfa_cpu_match_block));
+		match_type *matches = (match_type*)malloc(capacity * sizeof(match_type));
+		if (block == NULL || matches == NULL) {
+			free(block);
+			free(matches);
+			return NULL;
+		}
+		block->matches   = matches;
+		block->n_matches = 0;
+		block->capacity  = capacity;
+		block->prev      = last;
+		*buf = last = block;
+	}
+	return last->matches + last->n_matches;
+}
+
+static size_t match_buffer_free(udfa_cpu_match_block *buf){
+	size_t bytes = 0;
+	while (buf) {
+		udfa_cpu_match_block *prev = buf->prev;
+		bytes += buf->capacity * sizeof(match_type);
+		free(buf->matches);
+		free(buf);
+		buf = prev;
+	}
+	return bytes;
+}
+/*--------------------------------------------------------------------------------------------------*/
+//everything the worker threads share while the packets x DFAs grid is being processed
+typedef struct _udfa_cpu_grid{
+	std::vector<FiniteAutomaton *> *fa;
+	std::vector<udfa_cpu_dfa>       dfas;//state table and input symbol classes of each DFA group
+	std::vector<std::vector<udfa_cpu_dfa> > node_dfas;//-r 1: dfas reading the table copies of each NUMA node
+	std::vector<unsigned int>       cpus;//-P: CPU of each worker thread (empty - threads are not pinned)
+	std::vector<udfa_cpu_literals>  literals;//required literals of each DFA group (empty - no prefilter)
+	Packets                        *packets;
+	const symbol                   *payloads;
+	const size_t                   *pkt_offsets;//packets are views of the input (overlapping with -S 1), padded to a multiple of fetch_bytes
+	unsigned int                    n_packets;
+	unsigned int                    n_subsets;
+	unsigned int                   *match_count;//matches kept by each cell
+	unsigned int                   *match_found;//matches found by each cell (more than match_count when some were dropped)
+	const match_type              **cell_matches;//matches of each cell, in the buffer of the thread that stored them
+	udfa_cpu_match_block          **buffers;//one per worker thread of each pass
+	std::atomic<unsigned int>       next_buffer;
+	unsigned int                    max_matches;//-M: matches kept per cell (0 - no limit)
+	unsigned int                    interleave;
+	char                           *dfa_state_tables;//concatenated tables (SIMD kernel only)
+	std::vector<char *>             node_state_tables;//-r 1: copy of dfa_state_tables on each NUMA node (NULL - none)
+	unsigned int                   *accum_dfa_state_table_offsets;//in bytes
+	unsigned int                   *state_widths;
+	unsigned int                   *row_strides;
+	unsigned int                   *accept_offsets;
+	int                            *dead_states;
+	int                            *alphabet_cols;//per chunk of simd_lanes DFAs: CSIZE x SIMD_MAX_LANES symbol classes (SIMD kernel only)
+	unsigned int                    simd_lanes;
+	state_t                        *start_states;//speculative scanning (-S 3): entry each cell was started from
+	state_t                        *final_states;//speculative scanning (-S 3): entry each cell ended in
+	unsigned int                    lookback;//speculative scanning (-S 3): bytes of the previous packet used to predict the start entry
+	std::atomic<unsigned int>       mispredicted;
+	std::atomic<unsigned long long> rescanned;
+	std::atomic<unsigned int>       prefiltered;//cells skipped by the literal prefilter
+	std::vector<unsigned int>       tile_pkts;//scalar, interleaved and speculative kernels: packets per (packet range, DFA group) tile of each group
+	std::vector<unsigned int>       first_tile;//tiles of group i: first_tile[i] to first_tile[i+1]-1
+	TaskScheduler                   sched;//units of work of the current pass, stolen between threads
+	std::atomic<unsigned int>      *cells_left;//per DFA group: cells (and fix-up pass) still to be done before its report can be built
+	std::mutex                      report_mutex;
+	std::condition_variable         report_cond;//signalled when the cells_left of a group drops to 0
+} udfa_cpu_grid;
+
+//per-thread state of a worker
+typedef struct _udfa_cpu_worker_ctx{
+	udfa_cpu_grid *grid;
+	unsigned int   buffer;//this thread's entry of grid->buffers
+	unsigned int   thread;//this thread's index in grid->sched
+	int            node;//NUMA node of the CPU the thread is pinned to (-1 - not pinned)
+	const udfa_cpu_dfa *dfas;//grid->dfas, or the ones reading the table copies of the thread's node
+	const char    *dfa_state_tables;//SIMD kernel: grid->dfa_state_tables, or the copy on the thread's node
+	unsigned int   cell, cell_end;//cells of the current tile still to be done (scalar, interleaved and speculative kernels)
+	unsigned int   match_vec_size;//room given to the next cell, doubled whenever a cell of this thread finds more matches
+	bool           fixup;//fix-up pass: cells done here were already counted in cells_left by the scan
+} udfa_cpu_worker_ctx;
+
+//pins the calling thread to cpu; the pages it allocates from now on (its match buffers) come from the node of cpu
+static int udfa_cpu_pin(unsigned int cpu){
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		return -1;
+	int node = MemController::numa_node_of_cpu(cpu);
+	MemController::prefer_node(node);
+	return node;
+}
+
+static void worker_ctx_init(udfa_cpu_worker_ctx *ctx, udfa_cpu_grid *grid){
+	ctx->grid           = grid;
+	ctx->buffer         = grid->next_buffer.fetch_add(1);
+	ctx->thread         = grid->sched.attach();
+	ctx->cell           = 0;
+	ctx->cell_end       = 0;
+	ctx->node           = grid->cpus.empty() ? -1 : udfa_cpu_pin(grid->cpus[ctx->thread % grid->cpus.size()]);
+	ctx->dfas           = &grid->dfas[0];
+	ctx->dfa_state_tables = grid->dfa_state_tables;
+	if (ctx->node >= 0 && ctx->node < (int)grid->node_dfas.size())
+		ctx->dfas = &grid->node_dfas[ctx->node][0];
+	if (ctx->node >= 0 && ctx->node < (int)grid->node_state_tables.size() && grid->node_state_tables[ctx->node])
+		ctx->dfa_state_tables = grid->node_state_tables[ctx->node];
+	ctx->match_vec_size = CPU_MATCH_VEC_SIZE;
+	ctx->fixup          = false;
+}
+
+//next cell of the tiles taken by the thread: a tile is tile_pkts consecutive packets of one DFA group, so a thread
+//keeps to one state table while its packets stream through it (see udfa_cpu_tiling)
+static bool next_tile_cell(udfa_cpu_worker_ctx *ctx, unsigned int *cell){
+	udfa_cpu_grid *grid = ctx->grid;
+	if (ctx->cell == ctx->cell_end) {
+		unsigned int tile;
+		if (!grid->sched.next(ctx->thread, &tile))
+			return false;
+		unsigned int dfa_id    = std::upper_bound(grid->first_tile.begin(), grid->first_tile.end(), tile) - grid->first_tile.begin() - 1;
+		unsigned int tile_pkts = grid->tile_pkts[dfa_id];
+		unsigned int first_pkt = (tile - grid->first_tile[dfa_id]) * tile_pkts;
+		unsigned int n_pkts    = grid->n_packets - first_pkt < tile_pkts ? grid->n_packets - first_pkt : tile_pkts;
+		ctx->cell     = first_pkt + dfa_id * grid->n_packets;
+		ctx->cell_end = ctx->cell + n_pkts;
+	}
+	*cell = ctx->cell++;
+	return true;
+}
+
+//one more piece of work of group dfa_id is done; the last one wakes up the report thread
+static void group_step_done(udfa_cpu_grid *grid, unsigned int dfa_id){
+	if (grid->cells_left[dfa_id].fetch_sub(1) == 1) {
+		std::lock_guard<std::mutex> lock(grid->report_mutex);
+		grid->report_cond.notify_all();
+	}
+}
+
+static unsigned int cell_limit(const udfa_cpu_grid *grid, unsigned int found){
+	return (grid->max_matches != 0 && found > grid->max_matches) ? grid->max_matches : found;
+}
+
+static void worker_ctx_grow(udfa_cpu_worker_ctx *ctx, unsigned int n){
+	while (ctx->match_vec_size < n && ctx->match_vec_size < 0x80000000u)
+		ctx->match_vec_size *= 2;
+}
+
+//false when the packet holds none of the required literals of the group: none of its rules can match there
+static bool packet_has_literal(const udfa_cpu_grid *grid, unsigned int dfa_id, unsigned int pkt_id){
+	if (grid->literals.empty() || grid->literals[dfa_id].n_fingerprint == 0)
+		return true;
+	return udfa_cpu_literals_find(&grid->literals[dfa_id], grid->payloads + grid->pkt_offsets[pkt_id], grid->packets->get_payload_sizes()[pkt_id]);
+}
+
+//the last kept matches of the worker buffer belong to cell
+static void cell_done(udfa_cpu_worker_ctx *ctx, unsigned int cell, unsigned int found, unsigned int kept){
+	udfa_cpu_match_block *buf = ctx->grid->buffers[ctx->buffer];
+	ctx->grid->cell_matches[cell] = buf ? buf->matches + buf->n_matches : NULL;
+	ctx->grid->match_found[cell]  = found;
+	ctx->grid->match_count[cell]  = kept;
+	if (buf)
+		buf->n_matches += kept;
+	if (!ctx->fixup)
+		group_step_done(ctx->grid, cell / ctx->grid->n_packets);
+}
+
+//scans one cell straight into the worker buffer, from *current_state; a cell that finds more matches than
+//there was room for is scanned again with room for all of them (scans are deterministic)
+static void scan_cell(udfa_cpu_worker_ctx *ctx, unsigned int cell, const symbol *input, unsigned int size, state_t *current_state){
+	udfa_cpu_grid *grid = ctx->grid;
+	udfa_cpu_match_block **buf = &grid->buffers[ctx->buffer];
+	const udfa_cpu_dfa *dfa = &ctx->dfas[cell / grid->n_packets];
+	state_t start_state = *current_state;
+
+	unsigned int found;
+	match_type *matches = match_buffer_reserve(buf, ctx->match_vec_size);
+	unsigned int room = matches ? ctx->match_vec_size : 0;
+	udfa_cpu_kernel(dfa, input, size, current_state, &found, matches, room);
+
+	unsigned int kept = cell_limit(grid, found);
+	if (kept > room) {
+		worker_ctx_grow(ctx, kept);
+		matches = match_buffer_reserve(buf, kept);
+		if (matches) {
+			*current_state = start_state;
+			udfa_cpu_kernel(dfa, input, size, current_state, &found, matches, kept);
+		}
+		else
+			kept = room;//out of memory: keep what the first scan stored
+	}
+	cell_done(ctx, cell, found, kept);
+}
+
+//moves the matches a kernel stored for one cell in a scratch array of room entries to the worker buffer;
+//cells that overflowed the scratch array are scanned again from the start state
+static void store_cell(udfa_cpu_worker_ctx *ctx, unsigned int cell, const match_type *scratch, unsigned int room, unsigned int found){
+	udfa_cpu_grid *grid = ctx->grid;
+	if (cell_limit(grid, found) > room) {
+		unsigned int pkt_id = cell % grid->n_packets;
+		state_t current_state = 0;
+		scan_cell(ctx, cell, grid->payloads + grid->pkt_offsets[pkt_id], grid->packets->get_payload_sizes()[pkt_id], &current_state);
+		return;
+	}
+	unsigned int kept = cell_limit(grid, found);
+	match_type *matches = match_buffer_reserve(&grid->buffers[ctx->buffer], kept);
+	if (matches)
+		memcpy(matches, scratch, kept * sizeof(match_type));
+	else
+		kept = 0;
+	cell_done(ctx, cell, found, kept);
+}
+/*--------------------------------------------------------------------------------------------------*/
+static void udfa_cpu_worker(udfa_cpu_grid *grid){
+	udfa_cpu_worker_ctx ctx;
+	worker_ctx_init(&ctx, grid);
+
+	//cells are numbered like the GPU grid: packet (grid.x) varies fastest, DFA (grid.y) slowest
+	unsigned int cell;
+	while (next_tile_cell(&ctx, &cell)) {
+		unsigned int pkt_id = cell % grid->n_packets;
+		if (!packet_has_literal(grid, cell / grid->n_packets, pkt_id)) {
+			grid->prefiltered++;
+			cell_done(&ctx, cell, 0, 0);
+			continue;
+		}
+		state_t current_state = 0;
+		scan_cell(&ctx, cell, grid->payloads + grid->pkt_offsets[pkt_id], grid->packets->get_payload_sizes()[pkt_id], &current_state);
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+static void udfa_cpu_worker_stitched(udfa_cpu_grid *grid){
+	udfa_cpu_worker_ctx ctx;
+	worker_ctx_init(&ctx, grid);
+
+	//a unit of work is one DFA over all packets in order: each packet resumes from the state the previous one ended in,
+	//and only the input bytes are scanned, so that the padding of a packet does not reach the next one
+	unsigned int dfa_id;
+	while (grid->sched.next(ctx.thread, &dfa_id)) {
+		state_t current_state = 0;
+		for (unsigned int pkt_id = 0; pkt_id < grid->n_packets; pkt_id++)
+			scan_cell(&ctx, pkt_id + dfa_id * grid->n_packets, grid->payloads + grid->pkt_offsets[pkt_id], grid->packets->get_data_sizes()[pkt_id], &current_state);
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+static void udfa_cpu_worker_speculative(udfa_cpu_grid *grid){
+	udfa_cpu_worker_ctx ctx;
+	worker_ctx_init(&ctx, grid);
+
+	//every cell runs at once from a predicted entry: DFAs forget their past quickly, so the entry reached by
+	//scanning the last lookback bytes of the previous packet from the start state is usually the right one
+	unsigned int cell;
+	while (next_tile_cell(&ctx, &cell)) {
+		unsigned int pkt_id = cell % grid->n_packets;
+		unsigned int dfa_id = cell / grid->n_packets;
+		state_t current_state = 0;
+		if (pkt_id > 0) {
+			unsigned int prev_size = grid->packets->get_data_sizes()[pkt_id-1];
+			unsigned int lookback  = grid->lookback < prev_size ? grid->lookback : prev_size;
+			unsigned int no_matches;
+			udfa_cpu_kernel(&ctx.dfas[dfa_id],
+			                grid->payloads + grid->pkt_offsets[pkt_id-1] + prev_size - lookback, lookback, &current_state,
+			                &no_matches, NULL, 0);
+		}
+		grid->start_states[cell] = current_state;
+		scan_cell(&ctx, cell, grid->payloads + grid->pkt_offsets[pkt_id], grid->packets->get_data_sizes()[pkt_id], &current_state);
+		grid->final_states[cell] = current_state;
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+static void udfa_cpu_worker_fixup(udfa_cpu_grid *grid){
+	udfa_cpu_worker_ctx ctx;
+	worker_ctx_init(&ctx, grid);
+	ctx.fixup = true;
+	std::vector<match_type> fixed(ctx.match_vec_size);
+
+	//a unit of work is one DFA: its packets are checked in order against the true final entry of the previous one,
+	//and a mispredicted packet is rescanned only up to the byte where the true and speculative runs meet
+	unsigned int dfa_id;
+	while (grid->sched.next(ctx.thread, &dfa_id)) {
+		state_t true_state = grid->final_states[dfa_id * grid->n_packets];
+		for (unsigned int pkt_id = 1; pkt_id < grid->n_packets; pkt_id++) {
+			unsigned int cell = pkt_id + dfa_id * grid->n_packets;
+			if (grid->start_states[cell] == true_state) {
+				true_state = grid->final_states[cell];
+				continue;
+			}
+			unsigned int found_fixed;
+			unsigned int data_size = grid->packets->get_data_sizes()[pkt_id];
+			state_t      from      = true_state;
+			unsigned int n_bytes   = udfa_cpu_kernel_fixup(&ctx.dfas[dfa_id],
+			                                               grid->payloads + grid->pkt_offsets[pkt_id], data_size, &true_state, grid->start_states[cell],
+			                                               &found_fixed, &fixed[0], fixed.size());
+			if (found_fixed > fixed.size()) {
+				fixed.resize(found_fixed);
+				true_state = from;
+				udfa_cpu_kernel_fixup(&ctx.dfas[dfa_id],
+				                      grid->payloads + grid->pkt_offsets[pkt_id], data_size, &true_state, grid->start_states[cell],
+				                      &found_fixed, &fixed[0], fixed.size());
+			}
+			if (n_bytes < data_size)//the runs met: the rest of the speculative scan stands
+				true_state = grid->final_states[cell];
+			grid->mispredicted++;
+			grid->rescanned += n_bytes;
+
+			//matches of the rescanned bytes replace the speculative ones, which are sorted by offset;
+			//the cell moves to this thread's buffer
+			const match_type *spec = grid->cell_matches[cell];
+			unsigned int first_kept = 0;
+			while (first_kept < grid->match_count[cell] && spec[first_kept].off < n_bytes)
+				first_kept++;
+			unsigned int n_spec = grid->match_count[cell] - first_kept;
+			unsigned int found  = found_fixed + (grid->match_found[cell] - first_kept);//exact unless -M dropped speculative matches of the rescanned bytes
+			unsigned int kept   = cell_limit(grid, found);
+			match_type *matches = match_buffer_reserve(&grid->buffers[ctx.buffer], kept);
+			if (matches == NULL)
+				kept = 0;
+			unsigned int n_fixed = found_fixed < kept ? found_fixed : kept;
+			if (n_spec > kept - n_fixed)
+				n_spec = kept - n_fixed;
+			memcpy(matches, &fixed[0], n_fixed * sizeof(match_type));
+			memcpy(matches + n_fixed, spec + first_kept, n_spec * sizeof(match_type));
+			cell_done(&ctx, cell, found, n_fixed + n_spec);
+		}
+		group_step_done(grid, dfa_id);
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+static void udfa_cpu_worker_interleaved(udfa_cpu_grid *grid){
+	udfa_cpu_worker_ctx ctx;
+	worker_ctx_init(&ctx, grid);
+
+	//each lane stores its matches in a scratch slot, moved to the worker buffer when its cell is done
+	udfa_cpu_stream lanes[CPU_MAX_INTERLEAVE];
+	unsigned int lane_slot[CPU_MAX_INTERLEAVE];
+	std::vector<match_type> slots[CPU_MAX_INTERLEAVE];
+	unsigned int free_slots[CPU_MAX_INTERLEAVE];
+	unsigned int n_free = grid->interleave;
+	for (unsigned int i = 0; i < grid->interleave; i++)
+		free_slots[i] = grid->interleave - 1 - i;
+	unsigned int n_lanes = 0;
+	bool grid_done = false;
+
+	while (1) {
+		//keep the lanes full: a lane whose cell is finished takes the next cell of the grid
+		while (!grid_done && n_lanes < grid->interleave) {
+			unsigned int cell;
+			if (!next_tile_cell(&ctx, &cell)) {
+				grid_done = true;
+				break;
+			}
+			unsigned int pkt_id = cell % grid->n_packets;
+			unsigned int dfa_id = cell / grid->n_packets;
+			unsigned int slot   = free_slots[--n_free];
+			if (slots[slot].size() < ctx.match_vec_size)
+				slots[slot].resize(ctx.match_vec_size);
+			udfa_cpu_stream &s = lanes[n_lanes];
+			s.dfa             = &ctx.dfas[dfa_id];
+			s.input           = grid->payloads + grid->pkt_offsets[pkt_id];
+			s.cur_pkt_size    = grid->packets->get_payload_sizes()[pkt_id];
+			s.p               = 0;
+			s.current_state   = 0;
+			s.shr_match_count = 0;
+			s.match_count     = &grid->match_count[cell];
+			s.match_array     = &slots[slot][0];
+			s.match_vec_size  = slots[slot].size();
+			lane_slot[n_lanes] = slot;
+			if (!packet_has_literal(grid, dfa_id, pkt_id)) {
+				grid->prefiltered++;
+				s.p = s.cur_pkt_size;
+			}
+			else if (s.dfa->accel_index && s.dfa->accel_index[0])//accelerated start state: the lane starts at the first symbol that can leave it
+				s.p = udfa_cpu_accel_skip(&s.dfa->accel[s.dfa->accel_index[0]-1], s.input, 0, s.cur_pkt_size);
+			if (s.p == s.cur_pkt_size) {
+				cell_done(&ctx, cell, 0, 0);
+				free_slots[n_free++] = slot;
+			}
+			else
+				n_lanes++;
+		}
+		if (n_lanes == 0)
+			break;
+
+		//run all lanes up to the end of the shortest remaining packet, in short runs if a lane can reach a dead state
+		unsigned int n_steps = lanes[0].cur_pkt_size - lanes[0].p;
+		bool dead_states = false;
+		for (unsigned int i = 0; i < n_lanes; i++) {
+			if (lanes[i].cur_pkt_size - lanes[i].p < n_steps)
+				n_steps = lanes[i].cur_pkt_size - lanes[i].p;
+			dead_states |= (lanes[i].dfa->dead_state >= 0);
+		}
+		if (dead_states && n_steps > CPU_DEAD_STATE_CHECK)
+			n_steps = CPU_DEAD_STATE_CHECK;
+		udfa_cpu_kernel_interleaved(lanes, n_lanes, n_steps);
+
+		for (unsigned int i = 0; i < n_lanes; ) {
+			if (lanes[i].current_state == lanes[i].dfa->dead_state)//nothing left to match in this packet
+				lanes[i].p = lanes[i].cur_pkt_size;
+			if (lanes[i].p == lanes[i].cur_pkt_size) {
+				store_cell(&ctx, lanes[i].match_count - grid->match_count, lanes[i].match_array, lanes[i].match_vec_size, lanes[i].shr_match_count);
+				free_slots[n_free++] = lane_slot[i];
+				--n_lanes;
+				lanes[i]     = lanes[n_lanes];
+				lane_slot[i] = lane_slot[n_lanes];
+			}
+			else
+				i++;
+		}
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+static void udfa_cpu_worker_simd(udfa_cpu_grid *grid){
+	udfa_cpu_worker_ctx ctx;
+	worker_ctx_init(&ctx, grid);
+	std::vector<match_type> scratch;
+	unsigned int counts[SIMD_MAX_LANES];
+
+	//a tile is one packet against simd_lanes consecutive DFAs (one slice of a grid.x column)
+	unsigned int tile;
+	while (grid->sched.next(ctx.thread, &tile)) {
+		unsigned int pkt_id    = tile % grid->n_packets;
+		unsigned int chunk     = tile / grid->n_packets;
+		unsigned int first_dfa = chunk * grid->simd_lanes;
+		unsigned int n_dfas    = grid->n_subsets - first_dfa < grid->simd_lanes ? grid->n_subsets - first_dfa : grid->simd_lanes;
+		unsigned int room      = ctx.match_vec_size;
+		bool has_literal = false;
+		for (unsigned int l = 0; l < n_dfas && !has_literal; l++)
+			has_literal = packet_has_literal(grid, first_dfa + l, pkt_id);
+		if (!has_literal) {//none of the DFAs can match in this packet
+			grid->prefiltered += n_dfas;
+			for (unsigned int l = 0; l < n_dfas; l++)
+				cell_done(&ctx, pkt_id + (first_dfa + l) * grid->n_packets, 0, 0);
+			continue;
+		}
+		scratch.resize((size_t)room * grid->simd_lanes);
+		udfa_cpu_kernel_gather(ctx.dfa_state_tables, &grid->accum_dfa_state_table_offsets[first_dfa],
+		                       &grid->state_widths[first_dfa], &grid->row_strides[first_dfa], &grid->accept_offsets[first_dfa], &grid->dead_states[first_dfa], &grid->alphabet_cols[(size_t)chunk*CSIZE*SIMD_MAX_LANES], n_dfas,
+		                       grid->payloads + grid->pkt_offsets[pkt_id], grid->packets->get_payload_sizes()[pkt_id],
+		                       counts, 1, &scratch[0], room, room);
+		for (unsigned int l = 0; l < n_dfas; l++)
+			store_cell(&ctx, pkt_id + (first_dfa + l) * grid->n_packets, &scratch[(size_t)room*l], room, counts[l]);
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+static void udfa_cpu_worker_simd_packets(udfa_cpu_grid *grid){
+	unsigned int tile_pkts = grid->simd_lanes * SIMD_PACKET_TILE;
+	unsigned int n_blocks  = (grid->n_packets + tile_pkts - 1) / tile_pkts;
+	udfa_cpu_worker_ctx ctx;
+	worker_ctx_init(&ctx, grid);
+	std::vector<match_type> scratch;
+	std::vector<unsigned int> counts(tile_pkts);
+	std::vector<unsigned int> sizes(tile_pkts);
+
+	//a tile is one DFA against tile_pkts consecutive packets (one slice of a grid.y row)
+	unsigned int tile;
+	while (grid->sched.next(ctx.thread, &tile)) {
+		unsigned int dfa_id    = tile / n_blocks;
+		unsigned int first_pkt = (tile % n_blocks) * tile_pkts;
+		unsigned int n_pkts    = grid->n_packets - first_pkt < tile_pkts ? grid->n_packets - first_pkt : tile_pkts;
+		unsigned int room      = ctx.match_vec_size;
+		scratch.resize((size_t)room * tile_pkts);
+		//packets without a required literal of the DFA are handed to the kernel as empty ones, which it completes at once
+		const unsigned int *pkt_sizes = &grid->packets->get_payload_sizes()[first_pkt];
+		if (!grid->literals.empty() && grid->literals[dfa_id].n_fingerprint) {
+			for (unsigned int j = 0; j < n_pkts; j++) {
+				sizes[j] = pkt_sizes[j];
+				if (!packet_has_literal(grid, dfa_id, first_pkt + j)) {
+					grid->prefiltered++;
+					sizes[j] = 0;
+				}
+			}
+			pkt_sizes = &sizes[0];
+		}
+		//packets are numbered from the first one of the tile, so that the scratch arrays only cover the tile
+		udfa_cpu_kernel_packets(&ctx.dfas[dfa_id],
+		                        grid->payloads, &grid->pkt_offsets[first_pkt], pkt_sizes,
+		                        0, n_pkts,
+		                        &counts[0], &scratch[0], room);
+		for (unsigned int j = 0; j < n_pkts; j++)
+			store_cell(&ctx, first_pkt + j + dfa_id * grid->n_packets, &scratch[(size_t)room*j], room, counts[j]);
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+//packets per tile of each DFA group. A tile streams CPU_TILE_REUSE times the size of the group's table (as much of it
+//as the cache level holding it can keep) through that table, so that bringing the table into the cache is paid for by
+//many lookups before the thread moves to another group: a few MB of packets for a table that fills the L2, at least
+//CPU_TILE_MIN_BYTES for tables that stay in the L1. The L3 is shared by the threads, each one keeping its own table
+//there. Tiles shrink when there would be too few of them to balance the threads
+static void udfa_cpu_tiling(udfa_cpu_grid *grid, std::vector<FiniteAutomaton *> &fa, unsigned int n_threads){
+	size_t l1 = MemController::cache_size(1), l2 = MemController::cache_size(2), l3 = MemController::cache_size(3);
+	if (l1 == 0) l1 = 32768;
+	if (l2 == 0) l2 = 1048576;
+	size_t thread_cache = (l3 / n_threads > l2) ? l3 / n_threads : l2;
+
+	size_t input_bytes = 0;
+	for (unsigned int j = 0; j < grid->n_packets; j++)
+		input_bytes += grid->packets->get_payload_sizes()[j];
+	size_t packet_bytes = input_bytes / grid->n_packets ? input_bytes / grid->n_packets : 1;
+	size_t max_tile = (size_t)grid->n_packets * grid->n_subsets / ((size_t)CPU_TILES_PER_THREAD * n_threads);
+	if (max_tile > grid->n_packets) max_tile = grid->n_packets;
+	if (max_tile == 0) max_tile = 1;
+
+	grid->tile_pkts.resize(grid->n_subsets);
+	grid->first_tile.resize(grid->n_subsets + 1);
+	grid->first_tile[0] = 0;
+	unsigned int min_pkts = grid->n_packets, max_pkts = 1;
+	for (unsigned int i = 0; i < grid->n_subsets; i++) {
+		size_t footprint = fa[i]->get_dfa_state_table_size() + CSIZE;//the table and the symbol class map
+		if (footprint > thread_cache)
+			footprint = thread_cache;
+		size_t tile_bytes = (footprint <= l1 / 2) ? CPU_TILE_MIN_BYTES : CPU_TILE_REUSE * footprint;
+		if (tile_bytes < CPU_TILE_MIN_BYTES)
+			tile_bytes = CPU_TILE_MIN_BYTES;
+		size_t tile_pkts = (tile_bytes + packet_bytes - 1) / packet_bytes;
+		if (tile_pkts > max_tile)
+			tile_pkts = max_tile;
+		grid->tile_pkts[i]    = tile_pkts;
+		grid->first_tile[i+1] = grid->first_tile[i] + (grid->n_packets + tile_pkts - 1) / tile_pkts;
+		if (tile_pkts < min_pkts) min_pkts = tile_pkts;
+		if (tile_pkts > max_pkts) max_pkts = tile_pkts;
+	}
+	printf("CPU caches: L1d %zu KB, L2 %zu KB, L3 %zu KB; tiles of %u to %u packets per DFA group\n", l1 / 1024, l2 / 1024, l3 / 1024, min_pkts, max_pkts);
+}
+/*--------------------------------------------------------------------------------------------------*/
+static void udfa_cpu_reporter(udfa_cpu_grid *grid, ReportWriter *writer, int *rulestartvec, unsigned int *total_matches){
+	unsigned int n_packets = grid->n_packets;
+
+	const char *extension = (cfg.get_report_format() == 1 ? ".bin" : ".txt");
+	if (cfg.get_merge_reports()) {
+		//one report for all groups: the merge starts when the last group is done
+		std::unique_lock<std::mutex> lock(grid->report_mutex);
+		for (unsigned int i = 0; i < grid->n_subsets; i++)
+			while (grid->cells_left[i] != 0)
+				grid->report_cond.wait(lock);
+		lock.unlock();
+
+		std::string report;
+		*total_matches = merge_states2rules(*grid->fa, grid->match_count, grid->cell_matches, *grid->packets, report, cfg.get_report_format(), rulestartvec);
+		std::ostringstream filename;
+		filename << "Report_cpu_" << grid->n_subsets << extension;
+		writer->submit(filename.str(), report);
+		return;
+	}
+
+	//the report of a group is built as soon as all its cells are done; cell_matches is laid out like the grid,
+	//so the matches of group i are the n_packets pointers from cell n_packets*i on
+	for (unsigned int i = 0; i < grid->n_subsets; i++) {
+		{
+			std::unique_lock<std::mutex> lock(grid->report_mutex);
+			while (grid->cells_left[i] != 0)
+				grid->report_cond.wait(lock);
+		}
+		std::string report;
+		*total_matches += (*grid->fa)[i]->mapping_states2rules(&grid->match_count[n_packets*i], &grid->cell_matches[n_packets*i], *grid->packets,
+		                                                       report, cfg.get_report_format(), rulestartvec, i);
+
+		std::ostringstream filename;
+		filename << "Report_cpu_" << grid->n_subsets << "_" << i+1 << extension;
+		writer->submit(filename.str(), report);
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+unsigned int udfa_run(std::vector<FiniteAutomaton *> fa, Packets &packets, unsigned int n_subsets, unsigned int packet_size, int *rulestartvec, ReportWriter &writer, double *t_alloc, double *t_kernel, double *t_collect, double *t_free, int *blocksize, int blksiz_tuning){
+
+	struct timeval c0, c1, c2, c3, c33, c4;
+	long seconds, useconds;
+	unsigned int *h_match_count;
+
+
+	for (unsigned int i = 0; i < n_subsets; ++i) {
+		cout << "Graph (DFA) " << i+1 << endl;
+		cout << "   + State count: " << cfg.get_state_count(i) << endl;
+		cout << endl;
+	}
+
+	gettimeofday(&c0, NULL);
+
+	unsigned int n_packets = packets.get_payload_sizes().size();
+	unsigned int n_cells_grid = n_packets * n_subsets;
+
+	cout << "n_packets: "       << n_packets
+         << ", n_subsets: "     << n_subsets
+         << ", Maximum matches allowed per (packet, DFA): ";
+	if (cfg.get_max_matches()) cout << cfg.get_max_matches() << endl;
+	else                       cout << "no limit" << endl;
+
+	h_match_count = (unsigned int*)calloc (n_cells_grid, sizeof(unsigned int));
+
+	udfa_cpu_grid grid;
+	grid.fa                            = &fa;
+	grid.packets                       = &packets;
+	grid.payloads                      = packets.get_payloads();
+	grid.pkt_offsets                   = &(packets.get_payload_offsets()[0]);
+	grid.n_packets                     = n_packets;
+	grid.n_subsets                     = n_subsets;
+	grid.match_count                   = h_match_count;
+	grid.match_found                   = (unsigned int*)calloc (n_cells_grid, sizeof(unsigned int));
+	grid.cell_matches                  = (const match_type**)calloc (n_cells_grid, sizeof(match_type*));
+	grid.buffers                       = NULL;
+	grid.next_buffer                   = 0;
+	grid.max_matches                   = cfg.get_max_matches();
+	grid.interleave                    = cfg.get_interleave();
+	grid.dfa_state_tables              = NULL;
+	grid.accum_dfa_state_table_offsets = NULL;
+	grid.state_widths                  = NULL;
+	grid.row_strides                   = NULL;
+	grid.accept_offsets                = NULL;
+	grid.dead_states                   = NULL;
+	grid.alphabet_cols                 = NULL;
+	grid.simd_lanes                    = 0;
+	grid.start_states                  = NULL;
+	grid.final_states                  = NULL;
+	grid.lookback                      = cfg.get_overlap_bytes();
+	grid.mispredicted                  = 0;
+	grid.rescanned                     = 0;
+	grid.prefiltered                   = 0;
+
+	grid.dfas.resize(n_subsets);
+	for (unsigned int i = 0; i < n_subsets; i++) {
+		grid.dfas[i].state_table     = fa[i]->get_state_table();
+		grid.dfas[i].state_width     = fa[i]->get_state_width();
+		grid.dfas[i].alphabet_tx     = fa[i]->get_alphabet_tx();
+		grid.dfas[i].alphabet_size   = fa[i]->get_alphabet_size();
+		grid.dfas[i].row_stride      = fa[i]->get_row_stride();
+		grid.dfas[i].accept_offset   = fa[i]->get_accept_offset();
+		grid.dfas[i].dead_state      = fa[i]->get_dead_state();
+		grid.dfas[i].accel           = fa[i]->get_accel();
+		grid.dfas[i].accel_index     = fa[i]->get_accel_index();
+	}
+	if (cfg.get_numa_replicate()) {
+		//the threads of each NUMA node read the copies of the tables on their node
+		grid.node_dfas.assign(MemController::numa_nodes(), grid.dfas);
+		for (unsigned int n = 0; n < grid.node_dfas.size(); n++)
+			for (unsigned int i = 0; i < n_subsets; i++)
+				grid.node_dfas[n][i].state_table = fa[i]->get_state_table(n);
+	}
+
+	unsigned int cpu_kernel = cfg.get_cpu_kernel();
+	bool stitched    = (cfg.get_segment_mode() == 2);
+	bool speculative = (cfg.get_segment_mode() == 3);
+	if ((stitched || speculative) && (cpu_kernel != 0 || grid.interleave > 1)) {
+		cout << "Packets stitched with -S 2 or -S 3 are scanned with the scalar kernel" << endl;
+		cpu_kernel = 0;
+	}
+	//literal prefilter: only for independent packets, since a stitched packet may end a match started before it
+	bool prefilter = false;
+	for (unsigned int i = 0; i < n_subsets; i++)
+		prefilter |= !fa[i]->get_literals().empty();
+	if (prefilter && (stitched || speculative))
+		cout << "Packets stitched with -S 2 or -S 3 are scanned without the literal prefilter" << endl;
+	else if (prefilter) {
+		grid.literals.resize(n_subsets);
+		for (unsigned int i = 0; i < n_subsets; i++)
+			udfa_cpu_literals_init(&grid.literals[i], fa[i]->get_literals());
+	}
+	if (speculative) {
+		grid.start_states = (state_t*)malloc ((size_t)n_packets * n_subsets * sizeof(state_t));
+		grid.final_states = (state_t*)malloc ((size_t)n_packets * n_subsets * sizeof(state_t));
+	}
+	if (cpu_kernel == 1) {
+		//SIMD kernel: gather from one concatenated table, like the device copy of the GPU engine
+		size_t tmp_dfa_state_table_total_size=0, tmp_accum_prev_dfa_state_table_size=0;//in bytes
+		for (unsigned int i = 0; i < n_subsets; i++)
+			tmp_dfa_state_table_total_size += fa[i]->get_dfa_state_table_size();
+
+		if (tmp_dfa_state_table_total_size > 0x7FFFFFFF) {//gathers take signed 32-bit byte offsets
+			cout << "Concatenated DFA state tables too large for the SIMD kernel, using the scalar kernel" << endl;
+			cpu_kernel = 0;
+		}
+		else {
+			//tables keep their own entry width; lanes load 32-bit words, so the copy ends with sizeof(state_t) spare bytes
+			size_t tables_bytes = tmp_dfa_state_table_total_size + sizeof(state_t);
+			grid.dfa_state_tables              = cfg.get_controller().alloc_host_on_node<char>(tables_bytes, cfg.get_numa_node(), "SIMD kernel state tables");
+			memset(grid.dfa_state_tables + tmp_dfa_state_table_total_size, 0, sizeof(state_t));
+			grid.accum_dfa_state_table_offsets = (unsigned int*)malloc (n_subsets * sizeof(unsigned int));
+			grid.state_widths                  = (unsigned int*)malloc (n_subsets * sizeof(unsigned int));
+			for (unsigned int i = 0; i < n_subsets; i++) {
+				memcpy(&grid.dfa_state_tables[tmp_accum_prev_dfa_state_table_size], fa[i]->get_state_table(), fa[i]->get_dfa_state_table_size());
+				grid.accum_dfa_state_table_offsets[i] = tmp_accum_prev_dfa_state_table_size;
+				grid.state_widths[i]                  = fa[i]->get_state_width();
+				tmp_accum_prev_dfa_state_table_size += fa[i]->get_dfa_state_table_size();
+			}
+			if (cfg.get_numa_replicate()) {
+				//a copy on every node the tables of the groups were copied to
+				grid.node_state_tables.assign(MemController::numa_nodes(), (char*)NULL);
+				for (unsigned int n = 0; n < grid.node_state_tables.size(); n++) {
+					if (fa[0]->get_state_table(n) == fa[0]->get_state_table())
+						continue;
+					grid.node_state_tables[n] = cfg.get_controller().alloc_host_on_node<char>(tables_bytes, n, "SIMD kernel state tables copy");
+					if (grid.node_state_tables[n])
+						memcpy(grid.node_state_tables[n], grid.dfa_state_tables, tables_bytes);
+				}
+			}
+			grid.simd_lanes = udfa_simd_lanes();
+
+			//symbol classes laid out so that one vector load gives the class of a symbol in every lane of a chunk
+			unsigned int n_chunks = (n_subsets + grid.simd_lanes - 1) / grid.simd_lanes;
+			grid.row_strides    = (unsigned int*)malloc (n_subsets * sizeof(unsigned int));
+			grid.accept_offsets = (unsigned int*)malloc (n_subsets * sizeof(unsigned int));
+			grid.dead_states    = (int*)malloc (n_subsets * sizeof(int));
+			grid.alphabet_cols  = (int*)malloc ((size_t)n_chunks * CSIZE * SIMD_MAX_LANES * sizeof(int));
+			for (unsigned int i = 0; i < n_subsets; i++) {
+				grid.row_strides[i]    = fa[i]->get_row_stride();
+				grid.accept_offsets[i] = fa[i]->get_accept_offset();
+				grid.dead_states[i]    = fa[i]->get_dead_state();
+			}
+			for (unsigned int k = 0; k < n_chunks; k++) {
+				for (unsigned int c = 0; c < CSIZE; c++) {
+					for (unsigned int l = 0; l < SIMD_MAX_LANES; l++) {
+						unsigned int i = k * grid.simd_lanes + (l < grid.simd_lanes ? l : 0);
+						if (i >= n_subsets) i = k * grid.simd_lanes;//unused lanes shadow lane 0
+						grid.alphabet_cols[((size_t)k*CSIZE + c)*SIMD_MAX_LANES + l] = fa[i]->get_alphabet_tx()[c];
+					}
+				}
+			}
+		}
+	}
+	else if (cpu_kernel == 2) {
+		//SIMD kernel over packets: lanes fetch fetch_bytes words (from any byte), so every packet must be padded
+		for (unsigned int j = 0; j < n_packets; j++) {
+			if (packets.get_payload_sizes()[j] % fetch_bytes != 0) {
+				cout << "Packet sizes are not multiples of " << fetch_bytes << " bytes, using the scalar kernel" << endl;
+				cpu_kernel = 0;
+				break;
+			}
+		}
+		grid.simd_lanes = udfa_simd_lanes();
+	}
+
+	unsigned int n_threads = cfg.get_cpu_threads();
+	if (n_threads == 0) n_threads = std::thread::hardware_concurrency();
+	if (n_threads == 0) n_threads = 1;
+	//units of work of the scan pass: (packet range, DFA group) tiles, whole DFAs when packets are stitched
+	unsigned int n_tasks;
+	if (stitched)
+		n_tasks = n_subsets;
+	else if (cpu_kernel == 1)
+		n_tasks = n_packets * ((n_subsets + grid.simd_lanes - 1) / grid.simd_lanes);
+	else if (cpu_kernel == 2)
+		n_tasks = (n_packets + grid.simd_lanes * SIMD_PACKET_TILE - 1) / (grid.simd_lanes * SIMD_PACKET_TILE) * n_subsets;
+	else {
+		udfa_cpu_tiling(&grid, fa, n_threads);
+		n_tasks = grid.first_tile[n_subsets];
+	}
+	if (n_threads > n_tasks) n_threads = n_tasks;
+	*blocksize = n_threads;
+	grid.buffers = (udfa_cpu_match_block**)calloc (2 * n_threads, sizeof(udfa_cpu_match_block*));//scan and fix-up passes
+	grid.cells_left = new std::atomic<unsigned int>[n_subsets];
+	for (unsigned int i = 0; i < n_subsets; i++)
+		grid.cells_left[i] = n_packets + (speculative ? 1 : 0);
+
+	gettimeofday(&c1, NULL);
+
+	void (*worker)(udfa_cpu_grid *);
+	if (stitched) {
+		printf("U-DFA CPU kernel (stitched packets)\n");
+		worker = udfa_cpu_worker_stitched;
+	}
+	else if (speculative) {
+		printf("U-DFA CPU kernel (speculative packets, %d lookback bytes)\n", grid.lookback);
+		worker = udfa_cpu_worker_speculative;
+	}
+	else if (cpu_kernel == 1) {
+		printf("U-DFA CPU kernel (SIMD over DFAs, %s, %d lanes)\n", udfa_simd_isa_name(), grid.simd_lanes);
+		worker = udfa_cpu_worker_simd;
+	}
+	else if (cpu_kernel == 2) {
+		printf("U-DFA CPU kernel (SIMD over packets, %s, %d lanes)\n", udfa_simd_isa_name(), grid.simd_lanes);
+		worker = udfa_cpu_worker_simd_packets;
+	}
+	else if (grid.interleave > 1) {
+		printf("U-DFA CPU kernel (interleaved)\n");
+		worker = udfa_cpu_worker_interleaved;
+	}
+	else {
+		printf("U-DFA CPU kernel\n");
+		worker = udfa_cpu_worker;
+	}
+	cout << "CPU launch info: threads = " << n_threads << ", interleave = " << grid.interleave << ", grid.x = " << n_packets << ", grid.y = " << n_subsets << ", tasks = " << n_tasks << endl;
+
+	//reports are built and written while the workers go on with the other groups
+	unsigned int total_matches=0;
+	std::thread reporter(udfa_cpu_reporter, &grid, &writer, rulestartvec, &total_matches);
+
+	//-P: the calling thread works too, so it is pinned like the others for the passes and then let go
+	cpu_set_t caller_cpus;
+	pthread_getaffinity_np(pthread_self(), sizeof(caller_cpus), &caller_cpus);
+	const std::vector<unsigned int> &cpu_list = cfg.get_cpu_list();
+	for (unsigned int c = 0; c < cpu_list.size(); c++) {
+		if (cpu_list[c] < CPU_SETSIZE && CPU_ISSET(cpu_list[c], &caller_cpus))
+			grid.cpus.push_back(cpu_list[c]);
+		else
+			cout << "CPU " << cpu_list[c] << " of -P is not available, no thread pinned to it" << endl;
+	}
+
+	grid.sched.start(n_threads, n_tasks);
+	std::vector<std::thread> workers;
+	for (unsigned int t = 1; t < n_threads; t++)
+		workers.push_back(std::thread(worker, &grid));
+	worker(&grid);//the calling thread works too
+	for (unsigned int t = 0; t < workers.size(); t++)
+		workers[t].join();
+	grid.sched.print_stats("scan");
+
+	if (speculative) {
+		//fix-up pass: one DFA per unit of work
+		unsigned int n_fixup_threads = n_threads < n_subsets ? n_threads : n_subsets;
+		grid.sched.start(n_fixup_threads, n_subsets);
+		workers.clear();
+		for (unsigned int t = 1; t < n_fixup_threads; t++)
+			workers.push_back(std::thread(udfa_cpu_worker_fixup, &grid));
+		udfa_cpu_worker_fixup(&grid);
+		for (unsigned int t = 0; t < workers.size(); t++)
+			workers[t].join();
+		grid.sched.print_stats("fix-up");
+		cout << "Speculation: " << grid.mispredicted << " of " << (n_packets - 1) * n_subsets << " (packet, DFA) starts mispredicted, "
+		     << grid.rescanned << " bytes rescanned" << endl;
+	}
+	if (!grid.cpus.empty()) {
+		pthread_setaffinity_np(pthread_self(), sizeof(caller_cpus), &caller_cpus);
+		MemController::prefer_node(-1);
+	}
+
+	if (!grid.literals.empty())
+		cout << "Literal prefilter: " << grid.prefiltered << " of " << n_cells_grid << " (packet, DFA) cells skipped" << endl;
+
+	gettimeofday(&c2, NULL);
+
+	gettimeofday(&c3, NULL);//nothing to copy back from a device
+
+	// Collect results
+	reporter.join();
+	unsigned long long dropped_matches=0;
+	for (unsigned int c = 0; c < n_cells_grid; c++)
+		dropped_matches += grid.match_found[c] - h_match_count[c];
+	printf("Host - Total number of matches %d\n", total_matches);
+	printf("Host - Matches dropped %llu\n", dropped_matches);
+
+	gettimeofday(&c33, NULL);
+
+	// Free some memory
+	free(h_match_count);
+	size_t buffer_bytes=0;
+	for (unsigned int b = 0; b < 2 * n_threads; b++)
+		buffer_bytes += match_buffer_free(grid.buffers[b]);
+	printf("Host - Match buffers: %.2f MB\n", buffer_bytes/1048576.0);
+	free(grid.buffers);
+	free(grid.match_found);
+	free(grid.cell_matches);
+	delete [] grid.cells_left;
+	cfg.get_controller().dealloc_host(grid.dfa_state_tables);
+	for (unsigned int n = 0; n < grid.node_state_tables.size(); n++)
+		cfg.get_controller().dealloc_host(grid.node_state_tables[n]);
+	free(grid.accum_dfa_state_table_offsets);
+	free(grid.state_widths);
+	free(grid.row_strides);
+	free(grid.accept_offsets);
+	free(grid.dead_states);
+	free(grid.alphabet_cols);
+	free(grid.start_states);
+	free(grid.final_states);
+
+	gettimeofday(&c4, NULL);
+
+	seconds  = c1.tv_sec  - c0.tv_sec;
+	useconds = c1.tv_usec - c0.tv_usec;
+	*t_alloc = ((double)seconds * 1000 + (double)useconds/1000.0);
+
+	seconds  = c2.tv_sec  - c1.tv_sec;
+	useconds = c2.tv_usec - c1.tv_usec;
+	*t_kernel= ((double)seconds * 1000 + (double)useconds/1000.0);
+
+	seconds    = c3.tv_sec  - c2.tv_sec;
+	useconds   = c3.tv_usec - c2.tv_usec;
+	*t_collect = ((double)seconds * 1000 + (double)useconds/1000.0);
+
+	seconds  = c4.tv_sec  - c33.tv_sec;
+	useconds = c4.tv_usec - c33.tv_usec;
+	*t_free  = ((double)seconds * 1000 + (double)useconds/1000.0);
+
+	seconds  = c33.tv_sec  - c3.tv_sec;
+	useconds = c33.tv_usec - c3.tv_usec;
+	printf("udfa_host_cpu.cpp: t_postprocesscpu= %lf(ms)\n", ((double)seconds * 1000 + (double)useconds/1000.0));
+
+	return total_matches;
+}
+/*--------------------------------------------------------------------------------------------------*/
+//ingest stage of the flow scan: the next packets of the capture with their pages read, until there are none (NULL)
+static void udfa_flow_ingest(Packets *input, PcapReader *capture, unsigned int batch_packets, SpscQueue<std::vector<pcap_packet> *> *batches){
+	while (1) {
+		std::vector<pcap_packet> *batch = new std::vector<pcap_packet>;
+		batch->reserve(batch_packets);
+		pcap_packet pkt;
+		while (batch->size() < batch_packets && capture->next(&pkt))
+			batch->push_back(pkt);
+		if (batch->empty()) {
+			delete batch;
+			break;
+		}
+		input->prefault_input(batch->front().offset, batch->back().offset + batch->back().size);
+		batches->push(batch);
+	}
+	std::vector<pcap_packet> *end = NULL;
+	batches->push(end);
+}
+
+unsigned int udfa_run_flows(std::vector<FiniteAutomaton *> fa, Packets &packets, PcapReader &capture, unsigned int n_subsets, int *rulestartvec, ReportWriter &writer, double *t_kernel){
+	struct timeval c0, c1;
+	long seconds, useconds;
+	gettimeofday(&c0, NULL);
+
+	udfa_flow_engine engine;
+	udfa_flow_engine_init(&engine, fa);
+	FlowTable table(&engine, cfg.get_max_flows(), cfg.get_flow_timeout());
+	printf("U-DFA CPU flow scan (up to %u flows, %u s idle timeout, %u bytes of DFA states per flow)\n",
+	       cfg.get_max_flows(), cfg.get_flow_timeout(), udfa_flow_state_size(&engine));
+	if (cfg.get_merge_reports())
+		cout << "Flows are reported per DFA group: matches of reassembled streams are not in capture order (-U 1 ignored)" << endl;
+
+	//pipeline: the ingest thread parses and reads the next packets of the capture while the flows are scanned here
+	unsigned int batch_packets = cfg.get_batch_packets() ? cfg.get_batch_packets() : CPU_FLOW_BATCH;
+	SpscQueue<std::vector<pcap_packet> *> batches(2);
+	std::thread ingest(udfa_flow_ingest, &packets, &capture, batch_packets, &batches);
+
+	const symbol *payloads = packets.get_payloads();
+	const char *extension = (cfg.get_report_format() == 1 ? ".bin" : ".txt");
+	std::vector<flow_chunk> chunks;
+	std::vector<unsigned int> match_count(n_subsets);
+	std::vector<match_type> match_array;
+	unsigned int match_vec_size = 0;//a chunk has at most one match per byte and group
+	std::vector<std::string> bodies(n_subsets);
+	std::vector<unsigned int> group_matches(n_subsets, 0);
+	std::vector<unsigned long long> group_records(n_subsets, 0);
+	unsigned int total_matches = 0;
+	unsigned long long scanned_bytes = 0;
+	size_t released = 0;
+	char line[64];
+	while (1) {
+		std::vector<pcap_packet> *batch;
+		batches.pop(batch);
+		if (batch == NULL)
+			break;
+		for (size_t k = 0; k < batch->size(); k++) {
+			void *flow_state = table.add((*batch)[k], chunks);
+			for (size_t c = 0; c < chunks.size(); c++) {
+				if (chunks[c].size > match_vec_size) {
+					match_vec_size = chunks[c].size;
+					match_array.resize((size_t)match_vec_size * n_subsets);
+				}
+				udfa_flow_scan(&engine, flow_state, payloads + chunks[c].offset, chunks[c].size, &match_count[0], &match_array[0], match_vec_size);
+				scanned_bytes += chunks[c].size;
+
+				for (unsigned int i = 0; i < n_subsets; i++) {
+					for (unsigned int m = 0; m < match_count[i]; m++) {
+						const match_type &match = match_array[(size_t)match_vec_size*i + m];
+						uint64_t off = chunks[c].offset + match.off;
+						unsigned int n_rules;
+						const unsigned int *rules = fa[i]->get_rules(match.stat, &n_rules);
+						if (cfg.get_report_format() == 1) {
+							if (n_rules == 0)
+								report_append_record(bodies[i], off, REPORT_NO_RULE);
+							for (unsigned int r = 0; r < n_rules; r++)
+								report_append_record(bodies[i], off, rules[r] + rulestartvec[i]);
+							group_records[i] += n_rules ? n_rules : 1;
+						}
+						else {
+							bodies[i].append(line, snprintf(line, sizeof(line), "%llu::\n", (unsigned long long)off));
+							for (unsigned int r = 0; r < n_rules; r++)
+								bodies[i].append(line, snprintf(line, sizeof(line), "    Rule: %u\n", rules[r] + rulestartvec[i]));
+						}
+					}
+					group_matches[i] += match_count[i];
+				}
+			}
+		}
+
+		//reports of the batch: the writer adds them to the ones of the previous batches
+		for (unsigned int i = 0; i < n_subsets; i++) {
+			std::string report;
+			if (cfg.get_report_format() == 1)
+				report_append_header(report, i + 1, group_matches[i], group_records[i]);
+			else
+				report.append(line, snprintf(line, sizeof(line), "REPORTS: Total matches: %u\n", group_matches[i]));
+			report.append(bodies[i]);
+			bodies[i].clear();
+			total_matches += group_matches[i];
+			group_matches[i] = 0;
+			group_records[i] = 0;
+
+			std::ostringstream filename;
+			filename << "Report_cpu_" << n_subsets << "_" << i+1 << extension;
+			writer.submit(filename.str(), report);
+		}
+		//held segments point into the capture too, but their pages are read again if they were dropped
+		packets.release_input(released, batch->front().offset);
+		released = batch->front().offset;
+		delete batch;
+	}
+	ingest.join();
+
+	gettimeofday(&c1, NULL);
+	seconds   = c1.tv_sec  - c0.tv_sec;
+	useconds  = c1.tv_usec - c0.tv_usec;
+	*t_kernel = ((double)seconds * 1000 + (double)useconds/1000.0);
+
+	printf("Host - Total number of matches %d\n", total_matches);
+	printf("Host - Flow bytes scanned %llu\n", scanned_bytes);
+	table.print_stats();
+	return total_matches;
+}
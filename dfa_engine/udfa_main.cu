@@ -8,17 +8,25 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <thread>
 
 #include <stdio.h>
+#include <limits.h>
 #include <sys/time.h>
-#include <sys/stat.h>
 
 #include "packets.h"
+#include "pcap_reader.h"
 #include "udfa_host.h"
+#include "report_writer.h"
+#include "spsc_queue.h"
 
 using namespace std;
 
-size_t getFilesize(const char* filename);
+size_t count_packets(size_t input_bytes, unsigned int packet_size, unsigned int packet_stride, unsigned int packet_overlap);
+void add_packets(Packets &packets, size_t input_bytes, unsigned int first_pkt, unsigned int last_pkt, unsigned int packet_size, unsigned int packet_stride, unsigned int packet_overlap);
+void ingest_batches(Packets *input, unsigned int n_packets, unsigned int batch_packets, unsigned int packet_size, unsigned int packet_stride, unsigned int packet_overlap, SpscQueue<Packets *> *batches);
+void ingest_capture(Packets *input, PcapReader *capture, unsigned int batch_packets, SpscQueue<Packets *> *batches);
+bool parse_cpu_list(const char *list, std::vector<unsigned int> &cpus);
 void Usage(void);
 bool ParseCommandLine(int argc, char *argv[]);
 
@@ -40,7 +48,6 @@ int main(int argc, char* argv[]){
     unsigned int retval;
     std::vector<FiniteAutomaton *> dfa_vec;
 	    
-	char char_temp;
     char filename[1500], bufftmp[10];
 
 	struct timeval c1, c2, c3, c4, c5;
@@ -64,17 +71,27 @@ int main(int argc, char* argv[]){
 	if(!retval)
 		return 0;
 	
-    unsigned int total_bytes = getFilesize(cfg.get_input_file_name());
-
 	cout<< "-----------------User input info--------------------" << endl;
 	cout<< "Total number of rules: " << total_rules << endl;
-	cout<< "Total input bytes: "   << total_bytes << endl;	
 	unsigned int n_subsets   = cfg.get_groups();	
 	unsigned int n_packets   = cfg.get_packets();
-	unsigned int packet_size = ((total_bytes%n_packets)==0)?(total_bytes/n_packets):(total_bytes/n_packets+1);
+#ifndef CPU_ONLY
+	if (cfg.get_segment_mode() >= 2) {
+		cout<< "Stitched segments (-S 2, -S 3) need the CPU engine, using overlapping segments (-S 1)" << endl;
+		cfg.set_segment_mode(1);
+	}
+#endif
+	//with -S 1, packet j covers bytes [j*packet_stride, j*packet_stride + packet_overlap + packet_stride) of the input
+	//and its first packet_overlap bytes (j > 0) are the tail of packet j-1, so every match of up to packet_overlap + 1 bytes is found
+	unsigned int packet_overlap = (cfg.get_segment_mode() == 1 && n_packets > 1) ? cfg.get_overlap_bytes() : 0;
 	cout<< "Subgraph(s) (or DFA(s)) combined: "   << n_subsets << endl;
 	cout<< "Packet(s): "   << n_packets << endl;
-    cout<< "Packet size (bytes): " << packet_size << endl;
+	if (cfg.get_segment_mode() == 1)
+		cout<< "Packet overlap (bytes): " << packet_overlap << endl;
+	else if (cfg.get_segment_mode() == 2)
+		cout<< "Packets are stitched: each one starts from the final state of the previous one" << endl;
+	else if (cfg.get_segment_mode() == 3)
+		cout<< "Packets are stitched: each one starts from a predicted state, mispredictions are rescanned" << endl;
     if (automata_format ==0)
         cout << "Automata in binary format" << endl;
     else
@@ -83,6 +100,20 @@ int main(int argc, char* argv[]){
         cout << "Blocksize tuning is not enabled" << endl;
     else
         cout << "Blocksize tuning is enabled" << endl;
+#ifdef CPU_ONLY
+	if (cfg.get_numa_node() >= (int)MemController::numa_nodes()) {
+		cout << "NUMA node " << cfg.get_numa_node() << " not found, -n ignored" << endl;
+		cfg.set_numa_node(-1);
+	}
+	if (cfg.get_numa_replicate() && cfg.get_cpu_list().empty()) {
+		cout << "State tables are replicated on the nodes of the CPUs of -P, -r ignored without -P" << endl;
+		cfg.set_numa_replicate(0);
+	}
+	if (!cfg.get_cpu_list().empty())
+		cout << "Worker threads pinned to " << cfg.get_cpu_list().size() << " CPUs" << endl;
+	cfg.get_controller().set_page_policy(cfg.get_huge_pages());
+	cfg.get_controller().set_lock(cfg.get_lock_memory() != 0);
+#endif
 	
 	rulestartvec = (int*)malloc (n_subsets * sizeof(int));
 
@@ -123,6 +154,7 @@ int main(int argc, char* argv[]){
 	}
 
 	cout << "\nDFA loading done!!!\n\n";
+	cfg.get_controller().print_report();
 	
 	for (unsigned int i = 0; i < n_subsets; i++) {
 		if (i!=n_subsets-1) cout << "Sub-ruleset "<< i + 1 << ": Rules: " << rulestartvec[i+1] - rulestartvec[i] <<", States: "<< cfg.get_state_count(i) << endl;	
@@ -132,8 +164,6 @@ int main(int argc, char* argv[]){
 		
 	printf("-----------------Starting dfa execution--------------------\n");
     	
-	// open input stream file    
-	ifstream fp(cfg.get_input_file_name());
 #ifdef DEBUG
 	if (timing_filename != NULL)//and timing file
 		fp_timing.open(timing_filename,ios::binary | ios::out);
@@ -142,57 +172,98 @@ int main(int argc, char* argv[]){
 #endif
 		
 	unsigned int processed_packets = 0;
+	ReportWriter *writer = NULL;
 {	
 	gettimeofday(&c3, NULL);
 	
 	Packets packets;
-    vector<unsigned char> payload;
-    vector<unsigned int> payload_count;
 
-	// Read input stream file		
+	// Map input stream file: packets are views of the mapping, nothing is copied
 	//cout << "Fixed-size packet processing" << endl;
-	unsigned int cnt2=0;
-	unsigned int cnt=0;
-	if (fp){								
-		while ( fp.get(char_temp) ){
-			cnt2++;
-			payload.push_back(char_temp);
-			cnt++;					
-			if (cnt==packet_size){				
-				//version 2 -- note: padding to each packet if packet_size is not evenly divided by fetch_bytes (e.g. 4, 8)
-				if ( (cnt%fetch_bytes) != 0 ) {
-					for (unsigned int i = 0; i < (fetch_bytes-(cnt%fetch_bytes)); i++)
-						payload.push_back(0);
-					packets.set_padded_bytes(fetch_bytes-(cnt%fetch_bytes));
-				}				
-				packets.add_packet(payload);
-				payload_count.push_back(payload.size());//cout << payload.size() << endl;
-				processed_packets++;
-				payload.clear();
-				cnt=0;
+	size_t input_bytes = 0;
+	PcapReader capture;
+	bool pcap_input = false;
+	unsigned int packet_stride = 0, packet_size = 0;
+	if (packets.map_input(cfg.get_input_file_name())){
+		//the size read from the input itself, not from stat(), so that a pipe is cut into packets as well
+		input_bytes = packets.get_input_size();
+		cout<< "Total input bytes: "   << input_bytes << endl;
+		//a pcap or pcapng capture: the packets are the TCP and UDP payloads it holds, in capture order
+		pcap_input = capture.open(packets.get_payloads(), input_bytes);
+		if (!pcap_input) {
+			size_t stream_bytes = (input_bytes > packet_overlap) ? (input_bytes - packet_overlap) : 1;
+			size_t stride_bytes = ((stream_bytes%n_packets)==0)?(stream_bytes/n_packets):(stream_bytes/n_packets+1);
+			//packet sizes are 32-bit, padding included: larger packets are cut down, and the input is split into more of them
+			const size_t max_packet_size = (size_t)1 << 31;
+			if (stride_bytes + packet_overlap > max_packet_size) {
+				cout<< "Packets are limited to " << max_packet_size << " bytes, using more than " << n_packets << " packet(s)" << endl;
+				stride_bytes = max_packet_size - packet_overlap;
 			}
-		}
-		if ((cnt>0)&&(cnt<packet_size)){
-			//version 2 -- note: padding to each packet if packet_size is not evenly divided by fetch_bytes (e.g. 4, 8)
-			if ( (cnt%fetch_bytes) != 0 ) {
-				for (unsigned int i = 0; i < (fetch_bytes-(cnt%fetch_bytes)); i++)
-					payload.push_back(0);
-				packets.set_padded_bytes(fetch_bytes-(cnt%fetch_bytes));
+			packet_stride = stride_bytes;
+			packet_size   = packet_stride + packet_overlap;
+			cout<< "Packet size (bytes): " << packet_size << endl;
+			size_t n_input_packets = count_packets(input_bytes, packet_size, packet_stride, packet_overlap);
+			if (n_input_packets > UINT_MAX) {
+				cout<< "Too many packets (" << n_input_packets << "), at most " << UINT_MAX << " can be scanned" << endl;
+				return 0;
 			}
-			packets.add_packet(payload);
-			payload_count.push_back(payload.size());//cout << payload.size() << endl;
-			processed_packets++;
-			payload.clear();
-			cnt=0;
+			processed_packets = n_input_packets;
 		}
 	}
 	else{
 		cout<< "Cannot open input file" << endl;				
 	}
-	cout << "Number of processed packets: "<< processed_packets << " and total number of bytes: "<< cnt2 << endl;
-	for (unsigned int i = 0; i < processed_packets; i++){
-		cout << "Packet "<< i << ": " << payload_count[i] << " bytes (padding included)"<< endl;				
-	}			
+	if (pcap_input) {
+		cout << "Capture file: packets are its TCP and UDP payloads (-p ignored)" << endl;
+		if (cfg.get_segment_mode() != 0) {
+			cout << "Payloads of a capture are scanned as independent packets (-S 0)" << endl;
+			cfg.set_segment_mode(0);
+		}
+	}
+
+	//stitched packets depend on the final states of the previous ones, which the next batch would not have
+	unsigned int batch_packets = cfg.get_batch_packets();
+	if (batch_packets != 0 && cfg.get_segment_mode() >= 2) {
+		cout << "Packets stitched with -S 2 or -S 3 are scanned in one batch" << endl;
+		batch_packets = 0;
+	}
+	bool batched = pcap_input ? (batch_packets != 0) : (batch_packets != 0 && batch_packets < processed_packets);
+	bool flows = false;
+#ifdef CPU_ONLY
+	flows = pcap_input && cfg.get_max_flows() != 0;//the flow scan goes through the capture in batches itself
+#else
+	if (cfg.get_max_flows() != 0)
+		cout << "Flows (-F) need the CPU engine, payloads are scanned as independent packets" << endl;
+#endif
+	if (cfg.get_max_flows() != 0 && !pcap_input)
+		cout << "Flows (-F) need a capture file as input, -F ignored" << endl;
+	writer = new ReportWriter(batched || flows);//reports are written in the background while the next ones are built
+
+	if (flows)
+		cout << "TCP streams reassembled, flows scanned through a table of up to " << cfg.get_max_flows() << " flows" << endl;
+	else if (!batched) {
+		if (pcap_input) {
+			//a capture can hold millions of payloads: only their count and size are printed
+			processed_packets = capture.next_batch(packets, UINT_MAX);
+			size_t payload_bytes = 0;
+			for (unsigned int i = 0; i < processed_packets; i++)
+				payload_bytes += packets.get_data_sizes()[i];
+			cout << "Number of payloads: "<< processed_packets << ", " << payload_bytes << " bytes, from a capture of "<< packets.get_input_size() << " bytes" << endl;
+		}
+		else {
+			add_packets(packets, input_bytes, 0, processed_packets, packet_size, packet_stride, packet_overlap);
+			cout << "Number of processed packets: "<< processed_packets << " and total number of bytes: "<< packets.get_input_size() << endl;
+			for (unsigned int i = 0; i < processed_packets; i++){
+				cout << "Packet "<< i << ": " << packets.get_payload_sizes()[i] << " bytes (padding included)"<< endl;				
+			}
+		}
+	}
+	else if (pcap_input)
+		cout << "Batches of up to " << batch_packets << " payloads, total number of bytes: " << packets.get_input_size() << endl;
+	else {
+		cout << "Number of processed packets: "<< processed_packets << " and total number of bytes: "<< packets.get_input_size() << endl;
+		cout << "Batches: " << (processed_packets + batch_packets - 1) / batch_packets << " of up to " << batch_packets << " packets" << endl;
+	}
 	// End of Fixed-size packet processing
 	
 	//ofstream myfile2 ("./data/packet_cnts.txt");			
@@ -204,10 +275,56 @@ int main(int argc, char* argv[]){
 	gettimeofday(&c4, NULL);
 		
 	//cout << "UDFA!!!" << endl;
-	retval = udfa_run(dfa_vec, packets, n_subsets, packet_size, rulestartvec, &t_alloc, &t_kernel, &t_collect, &t_free, &blockSize, blksiz_tuning);	
+	//packets are stored back to back, each one padded to a multiple of fetch_bytes
+	t_alloc = t_kernel = t_collect = t_free = 0;
+	if (flows) {
+#ifdef CPU_ONLY
+		retval = udfa_run_flows(dfa_vec, packets, capture, n_subsets, rulestartvec, *writer, &t_kernel);
+#endif
+	}
+	else if (!batched) {
+		if (processed_packets > 0)
+			retval = udfa_run(dfa_vec, packets, n_subsets, packets.get_max_payload_size(), rulestartvec, *writer, &t_alloc, &t_kernel, &t_collect, &t_free, &blockSize, blksiz_tuning);	
+		else
+			cout << "No packets to scan" << endl;
+	}
+	else {
+		//pipeline: batch N+1 is packetized and its pages read by the ingest thread while batch N is scanned here and the
+		//reports of batch N-1 are written by the writer thread; the queues between the stages bound the batches in memory
+		SpscQueue<Packets *> batches(2);
+		std::thread ingest;
+		if (pcap_input)
+			ingest = std::thread(ingest_capture, &packets, &capture, batch_packets, &batches);
+		else
+			ingest = std::thread(ingest_batches, &packets, processed_packets, batch_packets, packet_size, packet_stride, packet_overlap, &batches);
+		double t_alloc_b, t_kernel_b, t_collect_b, t_free_b;
+		unsigned int total_matches = 0;
+		size_t released = 0;
+		processed_packets = 0;
+		while (1) {
+			Packets *batch;
+			batches.pop(batch);
+			if (batch == NULL)
+				break;
+			total_matches += udfa_run(dfa_vec, *batch, n_subsets, batch->get_max_payload_size(), rulestartvec, *writer, &t_alloc_b, &t_kernel_b, &t_collect_b, &t_free_b, &blockSize, blksiz_tuning);
+			t_alloc += t_alloc_b; t_kernel += t_kernel_b; t_collect += t_collect_b; t_free += t_free_b;
+			processed_packets += batch->get_payload_sizes().size();
+			//the input pages before this batch belong to batches already scanned
+			packets.release_input(released, batch->get_stream_offsets()[0]);
+			released = batch->get_stream_offsets()[0];
+			delete batch;
+		}
+		ingest.join();
+		printf("Host - Total number of matches (all batches) %d\n", total_matches);
+	}
+	if (pcap_input)
+		cout << "Capture: " << capture.get_records() << " records, " << capture.get_payloads() << " TCP and UDP payloads scanned" << endl;
 					
 	gettimeofday(&c5, NULL);
 }
+	writer->close();
+	printf("Host - Reports written: %.2f MB\n", writer->get_bytes_written()/1048576.0);
+	delete writer;
 	cout << "----------------- Kernel execution done -----------------" << endl;
 
 	seconds  = c2.tv_sec  - c1.tv_sec;
@@ -244,9 +361,6 @@ int main(int argc, char* argv[]){
 		fp_blksiz.write((char *)&blockSize, sizeof(int));
 #endif
 	
-	// close the file	
-	fp.close();
-
 #ifdef DEBUG	
 	if (timing_filename != NULL)
 		fp_timing.close();
@@ -260,8 +374,10 @@ int main(int argc, char* argv[]){
 	
 	cfg.get_controller().dealloc_host_all();
 	
+#ifndef CPU_ONLY
 	cudaDeviceReset();//Explicitly destroys and cleans up all resources associated with the current device in the current process. Note that this function will reset the device immediately. It is the caller's responsibility to ensure that the device is not being accessed by any other host threads from the process when this function is called.
 	//To prevent strange memory leak in some machines (or drivers)
+#endif
 	
 	free(rulestartvec);
 	
@@ -308,6 +424,34 @@ bool ParseCommandLine(int argc, char *argv[])
 			continue;
 		}
 		
+		if (strcmp(argv[CurrentItem], "-S") == 0)
+		{
+			CurrentItem++;
+			unsigned int segment_mode;
+			retVal = sscanf(argv[CurrentItem],"%u", &segment_mode);
+			if(retVal!=1 || segment_mode > 3 ){
+				printf("Invalid segment_mode param: %s\n", argv[CurrentItem]);
+				return false;
+			}
+			cfg.set_segment_mode(segment_mode);
+			CurrentItem++;
+			continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-V") == 0)
+		{
+			CurrentItem++;
+			unsigned int overlap_bytes;
+			retVal = sscanf(argv[CurrentItem],"%u", &overlap_bytes);
+			if(retVal!=1){
+				printf("Invalid overlap bytes number: %s\n", argv[CurrentItem]);
+				return false;
+			}
+			cfg.set_overlap_bytes(overlap_bytes);
+			CurrentItem++;
+			continue;
+		}
+		
 		if (strcmp(argv[CurrentItem], "-T") == 0)
 		{
 			CurrentItem++;
@@ -376,6 +520,271 @@ bool ParseCommandLine(int argc, char *argv[])
 				continue;
 		}
 
+		if (strcmp(argv[CurrentItem], "-c") == 0)
+			{
+				CurrentItem++;
+				unsigned int cpu_threads;
+				retVal = sscanf(argv[CurrentItem],"%u", &cpu_threads);
+				if(retVal!=1){
+					printf("Invalid CPU_THREADS number: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_cpu_threads(cpu_threads);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-I") == 0)
+			{
+				CurrentItem++;
+				unsigned int interleave;
+				retVal = sscanf(argv[CurrentItem],"%u", &interleave);
+				if(retVal!=1 || interleave < 1 || interleave > CPU_MAX_INTERLEAVE){
+					printf("Invalid interleave factor: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_interleave(interleave);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-K") == 0)
+			{
+				CurrentItem++;
+				unsigned int cpu_kernel;
+				retVal = sscanf(argv[CurrentItem],"%u", &cpu_kernel);
+				if(retVal!=1 || cpu_kernel > 2){
+					printf("Invalid cpu_kernel param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_cpu_kernel(cpu_kernel);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-A") == 0)
+			{
+				CurrentItem++;
+				unsigned int alphabet_reduction;
+				retVal = sscanf(argv[CurrentItem],"%u", &alphabet_reduction);
+				if(retVal!=1 || alphabet_reduction > 1){
+					printf("Invalid alphabet_reduction param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_alphabet_reduction(alphabet_reduction);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-W") == 0)
+			{
+				CurrentItem++;
+				unsigned int state_width_reduction;
+				retVal = sscanf(argv[CurrentItem],"%u", &state_width_reduction);
+				if(retVal!=1 || state_width_reduction > 1){
+					printf("Invalid state_width_reduction param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_state_width_reduction(state_width_reduction);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-R") == 0)
+			{
+				CurrentItem++;
+				unsigned int row_offsets;
+				retVal = sscanf(argv[CurrentItem],"%u", &row_offsets);
+				if(retVal!=1 || row_offsets > 2){
+					printf("Invalid row_offsets param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_row_offsets(row_offsets);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-X") == 0)
+			{
+				CurrentItem++;
+				unsigned int accel_escapes;
+				retVal = sscanf(argv[CurrentItem],"%u", &accel_escapes);
+				if(retVal!=1 || accel_escapes > CPU_ACCEL_MAX_ESCAPES){
+					printf("Invalid accel_escapes param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_accel_escapes(accel_escapes);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-L") == 0)
+			{
+				CurrentItem++;
+				unsigned int literal_prefilter;
+				retVal = sscanf(argv[CurrentItem],"%u", &literal_prefilter);
+				if(retVal!=1){
+					printf("Invalid literal_prefilter param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_literal_prefilter(literal_prefilter);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-F") == 0)
+			{
+				CurrentItem++;
+				unsigned int max_flows;
+				retVal = sscanf(argv[CurrentItem],"%u", &max_flows);
+				if(retVal!=1){
+					printf("Invalid max_flows param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_max_flows(max_flows);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-t") == 0)
+			{
+				CurrentItem++;
+				unsigned int flow_timeout;
+				retVal = sscanf(argv[CurrentItem],"%u", &flow_timeout);
+				if(retVal!=1){
+					printf("Invalid flow_timeout param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_flow_timeout(flow_timeout);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-P") == 0)
+			{
+				CurrentItem++;
+				std::vector<unsigned int> cpu_list;
+				if(!parse_cpu_list(argv[CurrentItem], cpu_list)){
+					printf("Invalid cpu_list param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_cpu_list(cpu_list);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-n") == 0)
+			{
+				CurrentItem++;
+				int numa_node;
+				retVal = sscanf(argv[CurrentItem],"%d", &numa_node);
+				if(retVal!=1 || numa_node < -1){
+					printf("Invalid numa_node param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_numa_node(numa_node);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-r") == 0)
+			{
+				CurrentItem++;
+				unsigned int numa_replicate;
+				retVal = sscanf(argv[CurrentItem],"%u", &numa_replicate);
+				if(retVal!=1 || numa_replicate > 1){
+					printf("Invalid numa_replicate param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_numa_replicate(numa_replicate);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-H") == 0)
+			{
+				CurrentItem++;
+				unsigned int huge_pages;
+				retVal = sscanf(argv[CurrentItem],"%u", &huge_pages);
+				if(retVal!=1 || huge_pages > HOST_PAGES_1G){
+					printf("Invalid huge_pages param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_huge_pages(huge_pages);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-l") == 0)
+			{
+				CurrentItem++;
+				unsigned int lock_memory;
+				retVal = sscanf(argv[CurrentItem],"%u", &lock_memory);
+				if(retVal!=1 || lock_memory > 1){
+					printf("Invalid lock_memory param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_lock_memory(lock_memory);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-M") == 0)
+			{
+				CurrentItem++;
+				unsigned int max_matches;
+				retVal = sscanf(argv[CurrentItem],"%u", &max_matches);
+				if(retVal!=1){
+					printf("Invalid max_matches number: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_max_matches(max_matches);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-B") == 0)
+			{
+				CurrentItem++;
+				unsigned int report_format;
+				retVal = sscanf(argv[CurrentItem],"%u", &report_format);
+				if(retVal!=1 || report_format > 1){
+					printf("Invalid report_format param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_report_format(report_format);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-U") == 0)
+			{
+				CurrentItem++;
+				unsigned int merge_reports;
+				retVal = sscanf(argv[CurrentItem],"%u", &merge_reports);
+				if(retVal!=1 || merge_reports > 1){
+					printf("Invalid merge_reports param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_merge_reports(merge_reports);
+				CurrentItem++;
+				continue;
+		}
+
+		if (strcmp(argv[CurrentItem], "-b") == 0)
+			{
+				CurrentItem++;
+				unsigned int batch_packets;
+				retVal = sscanf(argv[CurrentItem],"%u", &batch_packets);
+				if(retVal!=1){
+					printf("Invalid batch_packets param: %s\n", argv[CurrentItem]);
+					return false;
+				}
+				cfg.set_batch_packets(batch_packets);
+				CurrentItem++;
+				continue;
+		}
+
 		if (strcmp(argv[CurrentItem], "-m") == 0)
 			{
 				CurrentItem++;
@@ -409,35 +818,131 @@ bool ParseCommandLine(int argc, char *argv[])
 }
 
 void Usage(void) {
-    char string[]= "USAGE: ./dfa_engine [OPTIONS] \n" \
-					 "\t-a <file> :   automata name (must NOT contain the file extension)\n" \
-					 "\t-i <file> :   input file (with file extension)\n"  \
-					 "\t-T <n>    :   number of threads per block (overwritten if block size tuning feature is used)\n" \
-					 "\t-g <n>    :   number of graphs (or DFAs) to be executed (default: 1)\n" \
-					 "\t-p <n>    :   number of parallel packets to be examined (default: 1)\n"\
-					 "\t-N <n>    :   total number of rules (subgraphs)\n" \
-					 "\t-O <n>    :   0 - block size tuning not enabled; 1 - block size tuned (optional, default: 0 - not tuned)\n" \
-					 "\t-m <n>    :   0 - automata in binary format; 1 - automata in MNRL format (optional, default: 0 - binary)\n" \
+    char string[]= "USAGE: ./dfa_engine [OPTIONS] \n"
+					 "\t-a <file> :   automata name (must NOT contain the file extension)\n"
+					 "\t-i <file> :   input file (with file extension); pcap and pcapng captures are scanned payload by payload\n"
+					 "\t-T <n>    :   number of threads per block (overwritten if block size tuning feature is used)\n"
+					 "\t-g <n>    :   number of graphs (or DFAs) to be executed (default: 1)\n"
+					 "\t-p <n>    :   number of parallel packets to be examined (default: 1)\n"
+					 "\t-S <n>    :   0 - packets are independent; 1 - each packet also scans the last -V bytes of the previous one; 2 - each packet starts from the final state of the previous one; 3 - as 2, with packets scanned in parallel from predicted states and mispredictions rescanned (2 and 3: CPU engine only) (optional, default: 0)\n"
+					 "\t-V <n>    :   number of overlapping bytes between consecutive packets with -S 1, or of bytes used to predict the start state of a packet with -S 3 (optional, default: 1024)\n"
+					 "\t-N <n>    :   total number of rules (subgraphs)\n"
+					 "\t-O <n>    :   0 - block size tuning not enabled; 1 - block size tuned (optional, default: 0 - not tuned)\n"
+					 "\t-m <n>    :   0 - automata in binary format; 1 - automata in MNRL format (optional, default: 0 - binary)\n"
+					 "\t-M <n>    :   maximum number of matches reported per (packet, DFA) pair, the others are counted as dropped (optional, default: 0 - no limit on the CPU engine, the match array size on the GPU engine)\n"
+					 "\t-B <n>    :   0 - text reports (Report_*.txt); 1 - binary reports (Report_*.bin, see report_decode) (optional, default: 0)\n"
+					 "\t-U <n>    :   0 - one report per DFA group (Report_*_<g>_<i>); 1 - one report (Report_*_<g>) with the matches of all groups merged in offset order (optional, default: 0)\n"
+					 "\t-b <n>    :   number of packets per batch: a batch is scanned while the next one is read and the reports of the previous one are written (optional, default: 0 - all packets in one batch)\n"
+#ifdef CPU_ONLY
+					 "\t-c <n>    :   number of CPU worker threads (optional, default: 0 - one per hardware thread)\n"
+					 "\t-I <n>    :   number of (packet, DFA) streams interleaved by each CPU thread, 1 to 32 (optional, default: 1 - not interleaved)\n"
+					 "\t-K <n>    :   CPU kernel: 0 - scalar, one (packet, DFA) pair per call; 1 - SIMD, many DFAs over one packet; 2 - SIMD, one DFA over many packets (optional, default: 0)\n"
+					 "\t-A <n>    :   0 - full state table rows; 1 - rows reduced to the classes of equivalent input symbols (optional, default: 1)\n"
+					 "\t-W <n>    :   0 - 32-bit state table entries; 1 - 8-bit or 16-bit entries when the largest entry fits (optional, default: 1)\n"
+					 "\t-R <n>    :   state table entries: 0 - state ids; 1 - pre-multiplied row offsets unless they need wider entries than state ids; 2 - always row offsets (optional, default: 1)\n"
+					 "\t-X <n>    :   states that all input symbols but at most n (up to 16) lead back to are skipped over with a vector byte search; 0 - no skipping (optional, default: 16)\n"
+					 "\t-L <n>    :   a DFA group only scans the packets holding one of the required literals of its rules (<file>_lit.bin), if every rule has one of at least n bytes; 0 - no literal prefilter (optional, default: 2)\n"
+					 "\t-F <n>    :   capture input: TCP streams are reassembled and scanned through a table of up to n flows, so that matches span segments; 0 - payloads are independent packets (optional, default: 0)\n"
+					 "\t-t <n>    :   with -F, flows idle for n seconds of capture time are dropped (optional, default: 120)\n"
+					 "\t-P <list> :   CPUs the worker threads are pinned to, e.g. 0-7,16-23: thread t runs on the t-th CPU of the list (optional, default: threads are not pinned)\n"
+					 "\t-n <n>    :   NUMA node the state tables are placed on; -1 - wherever they are loaded (optional, default: -1)\n"
+					 "\t-r <n>    :   1 - a copy of the state tables on the NUMA node of every CPU of -P, each thread reads the copy of its node; 0 - one copy (optional, default: 0)\n"
+					 "\t-H <n>    :   largest pages for the state tables: 0 - 4 KB; 1 - transparent huge pages; 2 - 2 MB pages; 3 - 1 GB pages (2 and 3 from the hugetlb pool, smaller pages when it is empty) (optional, default: 1)\n"
+					 "\t-l <n>    :   1 - state tables locked in memory (mlock); 0 - not locked (optional, default: 0)\n"
+#endif
 #ifdef DEBUG
-					 "\t-f <name> :   timing result filename (optional, default: empty)\n" \
-					 "\t-ft <name>:   blocksize filename (optional, default: empty)\n" \
+					 "\t-f <name> :   timing result filename (optional, default: empty)\n"
+					 "\t-ft <name>:   blocksize filename (optional, default: empty)\n"
 #endif
-					 "\t-h        :   prints this message\n" \
-					 "Ex:\t./dfa_engine -a ./data/simple -i ./data/simple.input -T 1 -g 1 -p 1 -N 3\n" \
-					 "\t./dfa_engine -a ./data/simple -i ./data/simple.input -T 1 -g 1 -p 1 -N 3 -m 1\n" \
-					 "\t./dfa_engine -a ./data/simpletwo -i ./data/simpletwo.input -T 1 -g 2 -p 1 -N 6 -m 1\n" \
+					 "\t-h        :   prints this message\n"
+					 "Ex:\t./dfa_engine -a ./data/simple -i ./data/simple.input -T 1 -g 1 -p 1 -N 3\n"
+					 "\t./dfa_engine -a ./data/simple -i ./data/simple.input -T 1 -g 1 -p 1 -N 3 -m 1\n"
+					 "\t./dfa_engine -a ./data/simpletwo -i ./data/simpletwo.input -T 1 -g 2 -p 1 -N 6 -m 1\n"
 					 "\t./dfa_engine -a ./data/simpletwo -i ./data/simpletwo.input -T 2 -g 2 -p 1 -N 6 -m 1 -O 1\n";
     fprintf(stderr, "%s", string);
 }
 
+//CPU list such as 0-3,8,10-11: CPUs and ranges of CPUs, in the order given
+bool parse_cpu_list(const char *list, std::vector<unsigned int> &cpus) {
+	cpus.clear();
+	const char *p = list;
+	while (*p) {
+		unsigned int first, last;
+		int n;
+		if (sscanf(p, "%u%n", &first, &n) != 1)
+			return false;
+		p += n;
+		last = first;
+		if (*p == '-') {
+			p++;
+			if (sscanf(p, "%u%n", &last, &n) != 1 || last < first)
+				return false;
+			p += n;
+		}
+		for (unsigned int cpu = first; cpu <= last; cpu++)
+			cpus.push_back(cpu);
+		if (*p == ',')
+			p++;
+		else if (*p)
+			return false;
+	}
+	return !cpus.empty();
+}
+
+/**
+ * Number of packets of the input: packet j covers bytes [j*packet_stride, j*packet_stride + packet_size) while it fits in
+ * the input, then one more holds the rest of the input, unless it is all in the previous packet. The count is not
+ * bounded by UINT_MAX, so that the caller can reject an input cut into more packets than it can scan.
+ */
+size_t count_packets(size_t input_bytes, unsigned int packet_size, unsigned int packet_stride, unsigned int packet_overlap) {
+	size_t n_packets = (input_bytes >= packet_size) ? (input_bytes - packet_size) / packet_stride + 1 : 0;
+	size_t cnt = input_bytes - n_packets * packet_stride;
+	if ((cnt>0)&&(cnt<packet_size)&&((n_packets==0)||(cnt>packet_overlap)))
+		n_packets++;
+	return n_packets;
+}
+
 /**
- * Get the size of a file.
- * @return The filesize, or 0 if the file does not exist.
+ * Adds packets first_pkt to last_pkt - 1 of the input.
  */
- size_t getFilesize(const char* filename) {
-    struct stat st;
-    if(stat(filename, &st) != 0) {
-        return 0;
-    }
-    return st.st_size;   
-}
\ No newline at end of file
+void add_packets(Packets &packets, size_t input_bytes, unsigned int first_pkt, unsigned int last_pkt, unsigned int packet_size, unsigned int packet_stride, unsigned int packet_overlap) {
+	for (unsigned int j = first_pkt; j < last_pkt; j++) {
+		size_t offset = (size_t)j * packet_stride;
+		size_t cnt = input_bytes - offset;
+		packets.add_packet(offset, (cnt < packet_size) ? cnt : packet_size, (j > 0) ? packet_overlap : 0);
+	}
+}
+
+/**
+ * Ingest stage: packetizes the batches in order and reads their pages, then hands them to the scan (NULL after the last one).
+ */
+void ingest_batches(Packets *input, unsigned int n_packets, unsigned int batch_packets, unsigned int packet_size, unsigned int packet_stride, unsigned int packet_overlap, SpscQueue<Packets *> *batches) {
+	for (unsigned int first = 0; first < n_packets; first += batch_packets) {
+		unsigned int last = (n_packets - first > batch_packets) ? first + batch_packets : n_packets;
+		Packets *batch = new Packets;
+		batch->share_input(*input);
+		add_packets(*batch, input->get_input_size(), first, last, packet_size, packet_stride, packet_overlap);
+		input->prefault_input(batch->get_stream_offsets()[0], (size_t)batch->get_stream_offsets().back() + batch->get_data_sizes().back());
+		batches->push(batch);
+	}
+	Packets *end = NULL;
+	batches->push(end);
+}
+
+/**
+ * Ingest stage of a capture: the next batch_packets payloads of the capture, until there are no more.
+ */
+void ingest_capture(Packets *input, PcapReader *capture, unsigned int batch_packets, SpscQueue<Packets *> *batches) {
+	while (1) {
+		Packets *batch = new Packets;
+		batch->share_input(*input);
+		if (capture->next_batch(*batch, batch_packets) == 0) {
+			delete batch;
+			break;
+		}
+		input->prefault_input(batch->get_stream_offsets()[0], batch->get_stream_offsets().back() + batch->get_data_sizes().back());
+		batches->push(batch);
+	}
+	Packets *end = NULL;
+	batches->push(end);
+}
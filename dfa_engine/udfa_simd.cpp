@@ -0,0 +1,741 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * udfa_simd.cpp
+ *
+ * Vectorized CPU kernels. Every ISA-specific kernel is compiled with a target attribute
+ * so that the engine itself needs no -m flags; the widest kernel supported by the CPU
+ * is selected at run time and plain scalar code is used on older CPUs.
+ */
+
+#include <immintrin.h>
+#include <algorithm>
+
+#include "common.h"
+#include "udfa_cpu.h"
+#include "udfa_simd.h"
+
+typedef void (*gather_kernel_t)(const char *, const unsigned int *, const unsigned int *, const unsigned int *, const unsigned int *, const int *, const int *, unsigned int, const symbol *, unsigned int,
+                                unsigned int *, unsigned int, match_type *, size_t, unsigned int);
+typedef void (*packets_kernel_t)(const udfa_cpu_dfa *, const symbol *, const size_t *, const unsigned int *, unsigned int, unsigned int,
+                                 unsigned int *, match_type *, unsigned int);
+typedef unsigned int (*accel_skip_t)(const accel_type *, const symbol *, unsigned int, unsigned int);
+typedef bool (*literals_find_t)(const udfa_cpu_literals *, const symbol *, unsigned int);
+
+/*--------------------------------------------------------------------------------------------------*/
+//same bounded store as udfa_cpu_kernel, for one lane: matches past match_vec_size are counted, not stored
+static inline void record_match(unsigned int *lane_count, match_type *lane_array, unsigned int match_vec_size, unsigned int off, state_t state){
+	if (*lane_count < match_vec_size) {
+		match_type tmp_match;
+		tmp_match.off  = off;
+		tmp_match.stat = state;
+		lane_array[*lane_count] = tmp_match;
+	}
+	*lane_count = *lane_count + 1;
+}
+/*--------------------------------------------------------------------------------------------------*/
+static void gather_kernel_scalar(const char *dfa_state_tables, const unsigned int *accum_dfa_state_table_offsets,
+                                 const unsigned int *state_widths, const unsigned int *row_strides, const unsigned int *accept_offsets, const int *dead_states, const int *alphabet_cols, unsigned int n_dfas,
+                                 const symbol *input, unsigned int cur_pkt_size,
+                                 unsigned int *match_count, unsigned int count_stride,
+                                 match_type *match_array, size_t array_stride, unsigned int match_vec_size){
+	state_t current_states[SIMD_MAX_LANES];
+	unsigned int counts[SIMD_MAX_LANES];
+
+	for (unsigned int l = 0; l < n_dfas; l++) {
+		current_states[l] = 0;
+		counts[l] = 0;
+	}
+
+	for (unsigned int p = 0; p < cur_pkt_size; p++) {
+		unsigned int Input = input[p];
+		for (unsigned int l = 0; l < n_dfas; l++) {
+			state_t current_state = udfa_cpu_entry(dfa_state_tables + accum_dfa_state_table_offsets[l], state_widths[l],
+			                                       current_states[l] * row_strides[l] + alphabet_cols[Input*SIMD_MAX_LANES + l]);
+			if (current_state >= (state_t)accept_offsets[l]) {
+				record_match(&counts[l], &match_array[l*array_stride], match_vec_size, p, current_state);
+			}
+			current_states[l] = current_state;
+		}
+		if (p % CPU_DEAD_STATE_CHECK == CPU_DEAD_STATE_CHECK - 1) {//stop once every lane is in its dead state
+			unsigned int l = 0;
+			while (l < n_dfas && current_states[l] == dead_states[l])
+				l++;
+			if (l == n_dfas)
+				break;
+		}
+	}
+
+	for (unsigned int l = 0; l < n_dfas; l++)
+		match_count[l*count_stride] = counts[l];
+}
+/*--------------------------------------------------------------------------------------------------*/
+template<bool ROW_OFFSETS>
+__attribute__((target("avx2")))
+static void gather_kernel_avx2_encoding(const char *dfa_state_tables, const unsigned int *accum_dfa_state_table_offsets,
+                                        const unsigned int *state_widths, const unsigned int *row_strides, const unsigned int *accept_offsets, const int *dead_states, const int *alphabet_cols, unsigned int n_dfas,
+                                        const symbol *input, unsigned int cur_pkt_size,
+                                        unsigned int *match_count, unsigned int count_stride,
+                                        match_type *match_array, size_t array_stride, unsigned int match_vec_size){
+	int base[8], stride[8], accept[8], dead[8], scale[8], ext[8];
+	unsigned int counts[8];
+	for (unsigned int l = 0; l < 8; l++) {
+		unsigned int k = l < n_dfas ? l : 0;//unused lanes shadow lane 0
+		base[l]   = accum_dfa_state_table_offsets[k];
+		stride[l] = row_strides[k];
+		accept[l] = accept_offsets[k] - 1;
+		dead[l]   = dead_states[k];
+		scale[l]  = state_widths[k] == 1 ? 0 : (state_widths[k] == 2 ? 1 : 2);//log2 of the entry size
+		ext[l]    = 32 - 8*state_widths[k];//bits above the entry in the loaded 32-bit word
+		counts[l] = 0;
+	}
+	const int lane_mask = (1 << n_dfas) - 1;
+
+	__m256i v_base  = _mm256_loadu_si256((const __m256i *)base);
+	__m256i v_stride= _mm256_loadu_si256((const __m256i *)stride);
+	__m256i v_accept= _mm256_loadu_si256((const __m256i *)accept);
+	__m256i v_dead  = _mm256_loadu_si256((const __m256i *)dead);
+	__m256i v_scale = _mm256_loadu_si256((const __m256i *)scale);
+	__m256i v_ext   = _mm256_loadu_si256((const __m256i *)ext);
+	__m256i v_state = _mm256_setzero_si256();
+
+	for (unsigned int p = 0; p < cur_pkt_size; p++) {
+		__m256i v_col  = _mm256_loadu_si256((const __m256i *)&alphabet_cols[input[p]*SIMD_MAX_LANES]);//class of the symbol in each lane's DFA
+		__m256i v_row  = ROW_OFFSETS ? v_state : _mm256_mullo_epi32(v_state, v_stride);
+		__m256i v_idx  = _mm256_add_epi32(v_base, _mm256_sllv_epi32(_mm256_add_epi32(v_row, v_col), v_scale));//byte offsets
+		__m256i v_next = _mm256_i32gather_epi32((const int *)dfa_state_tables, v_idx, 1);
+		v_next = _mm256_srlv_epi32(_mm256_sllv_epi32(v_next, v_ext), v_ext);//keep the low bytes of 8-bit and 16-bit entries
+
+		int acc = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v_next, v_accept))) & lane_mask;//accepting states
+		if (acc) {
+			int states[8];
+			_mm256_storeu_si256((__m256i *)states, v_next);
+			while (acc) {
+				unsigned int l = __builtin_ctz(acc);
+				record_match(&counts[l], &match_array[l*array_stride], match_vec_size, p, states[l]);
+				acc &= acc - 1;
+			}
+		}
+		v_state = v_next;
+		if (p % CPU_DEAD_STATE_CHECK == CPU_DEAD_STATE_CHECK - 1 &&//stop once every lane is in its dead state
+		    (_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v_state, v_dead))) & lane_mask) == lane_mask)
+			break;
+	}
+
+	for (unsigned int l = 0; l < n_dfas; l++)
+		match_count[l*count_stride] = counts[l];
+}
+/*--------------------------------------------------------------------------------------------------*/
+template<bool ROW_OFFSETS>
+__attribute__((target("avx512f")))
+static void gather_kernel_avx512_encoding(const char *dfa_state_tables, const unsigned int *accum_dfa_state_table_offsets,
+                                          const unsigned int *state_widths, const unsigned int *row_strides, const unsigned int *accept_offsets, const int *dead_states, const int *alphabet_cols, unsigned int n_dfas,
+                                          const symbol *input, unsigned int cur_pkt_size,
+                                          unsigned int *match_count, unsigned int count_stride,
+                                          match_type *match_array, size_t array_stride, unsigned int match_vec_size){
+	int base[16], stride[16], accept[16], dead[16], scale[16], ext[16];
+	unsigned int counts[16];
+	for (unsigned int l = 0; l < 16; l++) {
+		unsigned int k = l < n_dfas ? l : 0;//unused lanes shadow lane 0
+		base[l]   = accum_dfa_state_table_offsets[k];
+		stride[l] = row_strides[k];
+		accept[l] = accept_offsets[k] - 1;
+		dead[l]   = dead_states[k];
+		scale[l]  = state_widths[k] == 1 ? 0 : (state_widths[k] == 2 ? 1 : 2);//log2 of the entry size
+		ext[l]    = 32 - 8*state_widths[k];//bits above the entry in the loaded 32-bit word
+		counts[l] = 0;
+	}
+	const __mmask16 lane_mask = (__mmask16)((1u << n_dfas) - 1);
+
+	__m512i v_base  = _mm512_loadu_si512(base);
+	__m512i v_stride= _mm512_loadu_si512(stride);
+	__m512i v_accept= _mm512_loadu_si512(accept);
+	__m512i v_dead  = _mm512_loadu_si512(dead);
+	__m512i v_scale = _mm512_loadu_si512(scale);
+	__m512i v_ext   = _mm512_loadu_si512(ext);
+	__m512i v_state = _mm512_setzero_si512();
+
+	for (unsigned int p = 0; p < cur_pkt_size; p++) {
+		__m512i v_col  = _mm512_loadu_si512(&alphabet_cols[input[p]*SIMD_MAX_LANES]);//class of the symbol in each lane's DFA
+		__m512i v_row  = ROW_OFFSETS ? v_state : _mm512_mullo_epi32(v_state, v_stride);
+		__m512i v_idx  = _mm512_add_epi32(v_base, _mm512_sllv_epi32(_mm512_add_epi32(v_row, v_col), v_scale));//byte offsets
+		__m512i v_next = _mm512_i32gather_epi32(v_idx, dfa_state_tables, 1);
+		v_next = _mm512_srlv_epi32(_mm512_sllv_epi32(v_next, v_ext), v_ext);//keep the low bytes of 8-bit and 16-bit entries
+
+		__mmask16 acc = _mm512_mask_cmpgt_epi32_mask(lane_mask, v_next, v_accept);//accepting states
+		if (acc) {
+			int states[16];
+			_mm512_storeu_si512(states, v_next);
+			unsigned int bits = acc;
+			while (bits) {
+				unsigned int l = __builtin_ctz(bits);
+				record_match(&counts[l], &match_array[l*array_stride], match_vec_size, p, states[l]);
+				bits &= bits - 1;
+			}
+		}
+		v_state = v_next;
+		if (p % CPU_DEAD_STATE_CHECK == CPU_DEAD_STATE_CHECK - 1 &&//stop once every lane is in its dead state
+		    _mm512_mask_cmpeq_epi32_mask(lane_mask, v_state, v_dead) == lane_mask)
+			break;
+	}
+
+	for (unsigned int l = 0; l < n_dfas; l++)
+		match_count[l*count_stride] = counts[l];
+}
+/*--------------------------------------------------------------------------------------------------*/
+//the multiply is compiled out when every lane holds row offsets
+static void gather_kernel_avx2(const char *dfa_state_tables, const unsigned int *accum_dfa_state_table_offsets,
+                               const unsigned int *state_widths, const unsigned int *row_strides, const unsigned int *accept_offsets, const int *dead_states, const int *alphabet_cols, unsigned int n_dfas,
+                               const symbol *input, unsigned int cur_pkt_size,
+                               unsigned int *match_count, unsigned int count_stride,
+                               match_type *match_array, size_t array_stride, unsigned int match_vec_size){
+	bool row_offsets = true;
+	for (unsigned int l = 0; l < n_dfas; l++)
+		if (row_strides[l] != 1) row_offsets = false;
+	if (row_offsets)
+		gather_kernel_avx2_encoding<true>(dfa_state_tables, accum_dfa_state_table_offsets, state_widths, row_strides, accept_offsets, dead_states, alphabet_cols, n_dfas,
+		                          input, cur_pkt_size, match_count, count_stride, match_array, array_stride, match_vec_size);
+	else
+		gather_kernel_avx2_encoding<false>(dfa_state_tables, accum_dfa_state_table_offsets, state_widths, row_strides, accept_offsets, dead_states, alphabet_cols, n_dfas,
+		                           input, cur_pkt_size, match_count, count_stride, match_array, array_stride, match_vec_size);
+}
+/*--------------------------------------------------------------------------------------------------*/
+//the multiply is compiled out when every lane holds row offsets
+static void gather_kernel_avx512(const char *dfa_state_tables, const unsigned int *accum_dfa_state_table_offsets,
+                                 const unsigned int *state_widths, const unsigned int *row_strides, const unsigned int *accept_offsets, const int *dead_states, const int *alphabet_cols, unsigned int n_dfas,
+                                 const symbol *input, unsigned int cur_pkt_size,
+                                 unsigned int *match_count, unsigned int count_stride,
+                                 match_type *match_array, size_t array_stride, unsigned int match_vec_size){
+	bool row_offsets = true;
+	for (unsigned int l = 0; l < n_dfas; l++)
+		if (row_strides[l] != 1) row_offsets = false;
+	if (row_offsets)
+		gather_kernel_avx512_encoding<true>(dfa_state_tables, accum_dfa_state_table_offsets, state_widths, row_strides, accept_offsets, dead_states, alphabet_cols, n_dfas,
+		                          input, cur_pkt_size, match_count, count_stride, match_array, array_stride, match_vec_size);
+	else
+		gather_kernel_avx512_encoding<false>(dfa_state_tables, accum_dfa_state_table_offsets, state_widths, row_strides, accept_offsets, dead_states, alphabet_cols, n_dfas,
+		                           input, cur_pkt_size, match_count, count_stride, match_array, array_stride, match_vec_size);
+}
+/*--------------------------------------------------------------------------------------------------*/
+//per-lane bookkeeping of the packet kernels; the vector registers are reloaded from it after every refill
+typedef struct _packet_lanes{
+	int          state[SIMD_MAX_LANES];
+	int          pos[SIMD_MAX_LANES];//next fetch_bytes word of the packet
+	int          start[SIMD_MAX_LANES];//first byte of the packet, relative to the first packet of the call (packets are views
+	                                   //of the input, so it need not be word-aligned: the gathers are byte-addressed)
+	int          nwords[SIMD_MAX_LANES];
+	int          active[SIMD_MAX_LANES];//-1 (all bits set) for lanes holding a packet, 0 otherwise
+	unsigned int pkt[SIMD_MAX_LANES];
+	unsigned int count[SIMD_MAX_LANES];
+	unsigned int next_pkt, end_pkt;
+	size_t       base_offset;//byte offset of the first packet of the call
+	const symbol     *payloads;
+	const accel_type *start_accel;//escapes of the start state if it is accelerated, NULL otherwise
+} packet_lanes;
+
+//give lane l the next non-empty packet (empty packets are completed on the way); false if none is left.
+//With an accelerated start state, the lane starts at the word of the first symbol that can leave it
+static bool lane_take_packet(packet_lanes *ln, unsigned int l, const size_t *pkt_offsets, const unsigned int *pkt_sizes, unsigned int *match_count){
+	while (ln->next_pkt < ln->end_pkt) {
+		unsigned int j = ln->next_pkt++;
+		unsigned int first = 0;
+		if (ln->start_accel && pkt_sizes[j] > 0)
+			first = udfa_cpu_accel_skip(ln->start_accel, ln->payloads + pkt_offsets[j], 0, pkt_sizes[j]) / fetch_bytes * fetch_bytes;
+		if (first == pkt_sizes[j]) {
+			match_count[j] = 0;
+			continue;
+		}
+		ln->state[l]  = 0;
+		ln->pos[l]    = first / fetch_bytes;
+		ln->start[l]  = pkt_offsets[j] - ln->base_offset;
+		ln->nwords[l] = pkt_sizes[j] / fetch_bytes;
+		ln->active[l] = -1;
+		ln->pkt[l]    = j;
+		ln->count[l]  = 0;
+		return true;
+	}
+	ln->active[l] = 0;
+	return false;
+}
+
+//complete the packets of the lanes in done_bits and refill those lanes; returns the new active bits
+static unsigned int lanes_refill(packet_lanes *ln, unsigned int n_lanes, unsigned int done_bits, const size_t *pkt_offsets, const unsigned int *pkt_sizes, unsigned int *match_count){
+	while (done_bits) {
+		unsigned int l = __builtin_ctz(done_bits);
+		match_count[ln->pkt[l]] = ln->count[l];
+		lane_take_packet(ln, l, pkt_offsets, pkt_sizes, match_count);
+		done_bits &= done_bits - 1;
+	}
+	unsigned int active_bits = 0;
+	for (unsigned int l = 0; l < n_lanes; l++)
+		if (ln->active[l]) active_bits |= 1u << l;
+	return active_bits;
+}
+
+static unsigned int lanes_init(packet_lanes *ln, unsigned int n_lanes, const udfa_cpu_dfa *dfa, const symbol *payloads, unsigned int first_pkt, unsigned int n_pkts, const size_t *pkt_offsets, const unsigned int *pkt_sizes, unsigned int *match_count){
+	ln->next_pkt    = first_pkt;
+	ln->end_pkt     = first_pkt + n_pkts;
+	ln->base_offset = pkt_offsets[first_pkt];
+	ln->payloads    = payloads;
+	ln->start_accel = (dfa->accel_index && dfa->accel_index[0]) ? &dfa->accel[dfa->accel_index[0]-1] : NULL;
+	for (unsigned int l = 0; l < n_lanes; l++) {
+		ln->pkt[l] = 0;
+		if (!lane_take_packet(ln, l, pkt_offsets, pkt_sizes, match_count)) {
+			ln->state[l] = ln->pos[l] = ln->start[l] = ln->nwords[l] = 0;
+		}
+	}
+	return lanes_refill(ln, n_lanes, 0, pkt_offsets, pkt_sizes, match_count);
+}
+/*--------------------------------------------------------------------------------------------------*/
+static void packets_kernel_scalar(const udfa_cpu_dfa *dfa,
+                                  const symbol *payloads, const size_t *pkt_offsets, const unsigned int *pkt_sizes,
+                                  unsigned int first_pkt, unsigned int n_pkts,
+                                  unsigned int *match_count, match_type *match_array, unsigned int match_vec_size){
+	for (unsigned int j = first_pkt; j < first_pkt + n_pkts; j++) {
+		state_t current_state = 0;
+		udfa_cpu_kernel(dfa, payloads + pkt_offsets[j], pkt_sizes[j], &current_state,
+		                &match_count[j], &match_array[(size_t)match_vec_size*j], match_vec_size);
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+template<unsigned int W, bool ROW_OFFSETS>
+__attribute__((target("avx2")))
+static void packets_kernel_avx2_width(const udfa_cpu_dfa *dfa,
+                                      const symbol *payloads, const size_t *pkt_offsets, const unsigned int *pkt_sizes,
+                                      unsigned int first_pkt, unsigned int n_pkts,
+                                      unsigned int *match_count, match_type *match_array, unsigned int match_vec_size){
+	packet_lanes ln;
+	unsigned int active_bits = lanes_init(&ln, 8, dfa, payloads, first_pkt, n_pkts, pkt_offsets, pkt_sizes, match_count);
+	const symbol *bytes_base = payloads + ln.base_offset;
+	const void *state_table = dfa->state_table;
+	int alphabet_cols[CSIZE];//32-bit copy of alphabet_tx, so that classes can be gathered
+	for (unsigned int c = 0; c < CSIZE; c++)
+		alphabet_cols[c] = dfa->alphabet_tx[c];
+
+	const __m256i v_zero  = _mm256_setzero_si256();
+	const __m256i v_one   = _mm256_set1_epi32(1);
+	const __m256i v_byte  = _mm256_set1_epi32(0xFF);
+	const __m256i v_stride= _mm256_set1_epi32(dfa->row_stride);
+	const __m256i v_accept= _mm256_set1_epi32(dfa->accept_offset - 1);
+	const __m256i v_dead  = _mm256_set1_epi32(dfa->dead_state);
+	const __m256i v_entry = _mm256_set1_epi32(W < sizeof(state_t) ? (1 << 8*W) - 1 : -1);
+
+	while (active_bits) {
+		__m256i v_state  = _mm256_loadu_si256((const __m256i *)ln.state);
+		__m256i v_pos    = _mm256_loadu_si256((const __m256i *)ln.pos);
+		__m256i v_start  = _mm256_loadu_si256((const __m256i *)ln.start);
+		__m256i v_nwords = _mm256_loadu_si256((const __m256i *)ln.nwords);
+		__m256i v_active = _mm256_loadu_si256((const __m256i *)ln.active);
+		unsigned int done_bits = 0;
+
+		//run until a lane reaches the end of its packet or the dead state, after which its packet cannot match
+		while (!done_bits) {
+			__m256i v_words = _mm256_mask_i32gather_epi32(v_zero, (const int *)bytes_base, _mm256_add_epi32(v_start, _mm256_slli_epi32(v_pos, 2)), v_active, 1);//fetch 4 bytes per lane
+			for (unsigned int byt = 0; byt < fetch_bytes; byt++) {
+				__m256i v_col  = _mm256_i32gather_epi32(alphabet_cols, _mm256_and_si256(v_words, v_byte), 4);
+				__m256i v_idx  = _mm256_add_epi32(ROW_OFFSETS ? v_state : _mm256_mullo_epi32(v_state, v_stride), v_col);
+				__m256i v_next = _mm256_mask_i32gather_epi32(v_state, (const int *)state_table, v_idx, v_active, W);
+				if (W < sizeof(state_t))//32-bit word loaded at the entry: keep its low W bytes
+					v_next = _mm256_and_si256(v_next, v_entry);
+				v_words = _mm256_srli_epi32(v_words, 8);
+
+				int acc = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(_mm256_cmpgt_epi32(v_next, v_accept), v_active)));//accepting states
+				if (acc) {
+					int states[8], pos[8];
+					_mm256_storeu_si256((__m256i *)states, v_next);
+					_mm256_storeu_si256((__m256i *)pos, v_pos);
+					while (acc) {
+						unsigned int l = __builtin_ctz(acc);
+						record_match(&ln.count[l], &match_array[(size_t)match_vec_size*ln.pkt[l]], match_vec_size, pos[l]*fetch_bytes + byt, states[l]);
+						acc &= acc - 1;
+					}
+				}
+				v_state = v_next;
+			}
+			v_pos = _mm256_add_epi32(v_pos, _mm256_and_si256(v_one, v_active));
+			done_bits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(_mm256_or_si256(_mm256_cmpeq_epi32(v_pos, v_nwords), _mm256_cmpeq_epi32(v_state, v_dead)), v_active)));
+		}
+
+		_mm256_storeu_si256((__m256i *)ln.state, v_state);
+		_mm256_storeu_si256((__m256i *)ln.pos, v_pos);
+		active_bits = lanes_refill(&ln, 8, done_bits, pkt_offsets, pkt_sizes, match_count);
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+template<unsigned int W, bool ROW_OFFSETS>
+__attribute__((target("avx512f")))
+static void packets_kernel_avx512_width(const udfa_cpu_dfa *dfa,
+                                        const symbol *payloads, const size_t *pkt_offsets, const unsigned int *pkt_sizes,
+                                        unsigned int first_pkt, unsigned int n_pkts,
+                                        unsigned int *match_count, match_type *match_array, unsigned int match_vec_size){
+	packet_lanes ln;
+	unsigned int active_bits = lanes_init(&ln, 16, dfa, payloads, first_pkt, n_pkts, pkt_offsets, pkt_sizes, match_count);
+	const symbol *bytes_base = payloads + ln.base_offset;
+	const void *state_table = dfa->state_table;
+	int alphabet_cols[CSIZE];//32-bit copy of alphabet_tx, so that classes can be gathered
+	for (unsigned int c = 0; c < CSIZE; c++)
+		alphabet_cols[c] = dfa->alphabet_tx[c];
+
+	const __m512i v_zero  = _mm512_setzero_si512();
+	const __m512i v_one   = _mm512_set1_epi32(1);
+	const __m512i v_byte  = _mm512_set1_epi32(0xFF);
+	const __m512i v_stride= _mm512_set1_epi32(dfa->row_stride);
+	const __m512i v_accept= _mm512_set1_epi32(dfa->accept_offset - 1);
+	const __m512i v_dead  = _mm512_set1_epi32(dfa->dead_state);
+	const __m512i v_entry = _mm512_set1_epi32(W < sizeof(state_t) ? (1 << 8*W) - 1 : -1);
+
+	while (active_bits) {
+		__m512i v_state  = _mm512_loadu_si512(ln.state);
+		__m512i v_pos    = _mm512_loadu_si512(ln.pos);
+		__m512i v_start  = _mm512_loadu_si512(ln.start);
+		__m512i v_nwords = _mm512_loadu_si512(ln.nwords);
+		__mmask16 active = (__mmask16)active_bits;
+		__mmask16 done   = 0;
+
+		//run until a lane reaches the end of its packet or the dead state, after which its packet cannot match
+		while (!done) {
+			__m512i v_words = _mm512_mask_i32gather_epi32(v_zero, active, _mm512_add_epi32(v_start, _mm512_slli_epi32(v_pos, 2)), bytes_base, 1);//fetch 4 bytes per lane
+			for (unsigned int byt = 0; byt < fetch_bytes; byt++) {
+				__m512i v_col  = _mm512_i32gather_epi32(_mm512_and_si512(v_words, v_byte), alphabet_cols, 4);
+				__m512i v_idx  = _mm512_add_epi32(ROW_OFFSETS ? v_state : _mm512_mullo_epi32(v_state, v_stride), v_col);
+				__m512i v_next = _mm512_mask_i32gather_epi32(v_state, active, v_idx, state_table, W);
+				if (W < sizeof(state_t))//32-bit word loaded at the entry: keep its low W bytes
+					v_next = _mm512_and_si512(v_next, v_entry);
+				v_words = _mm512_srli_epi32(v_words, 8);
+
+				__mmask16 acc = _mm512_mask_cmpgt_epi32_mask(active, v_next, v_accept);//accepting states
+				if (acc) {
+					int states[16], pos[16];
+					_mm512_storeu_si512(states, v_next);
+					_mm512_storeu_si512(pos, v_pos);
+					unsigned int bits = acc;
+					while (bits) {
+						unsigned int l = __builtin_ctz(bits);
+						record_match(&ln.count[l], &match_array[(size_t)match_vec_size*ln.pkt[l]], match_vec_size, pos[l]*fetch_bytes + byt, states[l]);
+						bits &= bits - 1;
+					}
+				}
+				v_state = v_next;
+			}
+			v_pos = _mm512_mask_add_epi32(v_pos, active, v_pos, v_one);
+			done  = _mm512_mask_cmpeq_epi32_mask(active, v_pos, v_nwords) | _mm512_mask_cmpeq_epi32_mask(active, v_state, v_dead);
+		}
+
+		_mm512_storeu_si512(ln.state, v_state);
+		_mm512_storeu_si512(ln.pos, v_pos);
+		active_bits = lanes_refill(&ln, 16, done, pkt_offsets, pkt_sizes, match_count);
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+template<unsigned int W>
+static void packets_kernel_avx2_encoding(const udfa_cpu_dfa *dfa,
+                                         const symbol *payloads, const size_t *pkt_offsets, const unsigned int *pkt_sizes,
+                                         unsigned int first_pkt, unsigned int n_pkts,
+                                         unsigned int *match_count, match_type *match_array, unsigned int match_vec_size){
+	if (dfa->row_stride == 1)
+		packets_kernel_avx2_width<W, true>(dfa, payloads, pkt_offsets, pkt_sizes, first_pkt, n_pkts, match_count, match_array, match_vec_size);
+	else
+		packets_kernel_avx2_width<W, false>(dfa, payloads, pkt_offsets, pkt_sizes, first_pkt, n_pkts, match_count, match_array, match_vec_size);
+}
+/*--------------------------------------------------------------------------------------------------*/
+static void packets_kernel_avx2(const udfa_cpu_dfa *dfa,
+                                const symbol *payloads, const size_t *pkt_offsets, const unsigned int *pkt_sizes,
+                                unsigned int first_pkt, unsigned int n_pkts,
+                                unsigned int *match_count, match_type *match_array, unsigned int match_vec_size){
+	switch (dfa->state_width) {
+		case 1:
+			packets_kernel_avx2_encoding<1>(dfa, payloads, pkt_offsets, pkt_sizes, first_pkt, n_pkts, match_count, match_array, match_vec_size);
+			break;
+		case 2:
+			packets_kernel_avx2_encoding<2>(dfa, payloads, pkt_offsets, pkt_sizes, first_pkt, n_pkts, match_count, match_array, match_vec_size);
+			break;
+		default:
+			packets_kernel_avx2_encoding<4>(dfa, payloads, pkt_offsets, pkt_sizes, first_pkt, n_pkts, match_count, match_array, match_vec_size);
+			break;
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+template<unsigned int W>
+static void packets_kernel_avx512_encoding(const udfa_cpu_dfa *dfa,
+                                           const symbol *payloads, const size_t *pkt_offsets, const unsigned int *pkt_sizes,
+                                           unsigned int first_pkt, unsigned int n_pkts,
+                                           unsigned int *match_count, match_type *match_array, unsigned int match_vec_size){
+	if (dfa->row_stride == 1)
+		packets_kernel_avx512_width<W, true>(dfa, payloads, pkt_offsets, pkt_sizes, first_pkt, n_pkts, match_count, match_array, match_vec_size);
+	else
+		packets_kernel_avx512_width<W, false>(dfa, payloads, pkt_offsets, pkt_sizes, first_pkt, n_pkts, match_count, match_array, match_vec_size);
+}
+/*--------------------------------------------------------------------------------------------------*/
+static void packets_kernel_avx512(const udfa_cpu_dfa *dfa,
+                                  const symbol *payloads, const size_t *pkt_offsets, const unsigned int *pkt_sizes,
+                                  unsigned int first_pkt, unsigned int n_pkts,
+                                  unsigned int *match_count, match_type *match_array, unsigned int match_vec_size){
+	switch (dfa->state_width) {
+		case 1:
+			packets_kernel_avx512_encoding<1>(dfa, payloads, pkt_offsets, pkt_sizes, first_pkt, n_pkts, match_count, match_array, match_vec_size);
+			break;
+		case 2:
+			packets_kernel_avx512_encoding<2>(dfa, payloads, pkt_offsets, pkt_sizes, first_pkt, n_pkts, match_count, match_array, match_vec_size);
+			break;
+		default:
+			packets_kernel_avx512_encoding<4>(dfa, payloads, pkt_offsets, pkt_sizes, first_pkt, n_pkts, match_count, match_array, match_vec_size);
+			break;
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+static unsigned int accel_skip_scalar(const accel_type *accel, const symbol *input, unsigned int p, unsigned int size){
+	if (accel->n_escapes == 1) {
+		const void *next = memchr(input + p, accel->escapes[0], size - p);
+		return next ? (const symbol *)next - input : size;
+	}
+	while (p < size && !(accel->lo[input[p] & 15] & accel->hi[input[p] >> 4]))
+		p++;
+	return p;
+}
+/*--------------------------------------------------------------------------------------------------*/
+//shufti: the low and high nibble of every byte select a bucket mask each, and a byte may be an escape when they share a bit
+__attribute__((target("avx2")))
+static unsigned int accel_skip_avx2(const accel_type *accel, const symbol *input, unsigned int p, unsigned int size){
+	if (accel->n_escapes == 1) {
+		const void *next = memchr(input + p, accel->escapes[0], size - p);
+		return next ? (const symbol *)next - input : size;
+	}
+	const __m256i v_lo     = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)accel->lo));
+	const __m256i v_hi     = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)accel->hi));
+	const __m256i v_nibble = _mm256_set1_epi8(0x0F);
+	const __m256i v_zero   = _mm256_setzero_si256();
+	for (; p + 32 <= size; p += 32) {
+		__m256i v_in  = _mm256_loadu_si256((const __m256i *)(input + p));
+		__m256i v_lob = _mm256_shuffle_epi8(v_lo, _mm256_and_si256(v_in, v_nibble));
+		__m256i v_hib = _mm256_shuffle_epi8(v_hi, _mm256_and_si256(_mm256_srli_epi16(v_in, 4), v_nibble));
+		unsigned int miss = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(v_lob, v_hib), v_zero));
+		if (miss != 0xFFFFFFFF)
+			return p + __builtin_ctz(~miss);
+	}
+	return accel_skip_scalar(accel, input, p, size);
+}
+/*--------------------------------------------------------------------------------------------------*/
+static inline symbol fold_case(symbol c){
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static bool literal_at(const std::pair<std::string, bool> &literal, const symbol *input, unsigned int p, unsigned int size){
+	const std::string &l = literal.first;
+	if (l.size() > size - p)
+		return false;
+	if (!literal.second)
+		return memcmp(input + p, l.data(), l.size()) == 0;
+	for (unsigned int k = 0; k < l.size(); k++)
+		if (fold_case(input[p + k]) != (symbol)l[k])
+			return false;
+	return true;
+}
+
+//does a literal of one of the buckets in bits start at position p
+static bool literals_verify(const udfa_cpu_literals *lit, unsigned int bits, const symbol *input, unsigned int p, unsigned int size){
+	while (bits) {
+		const std::vector<std::pair<std::string, bool> > &bucket = lit->bucket[__builtin_ctz(bits)];
+		for (unsigned int i = 0; i < bucket.size(); i++)
+			if (literal_at(bucket[i], input, p, size))
+				return true;
+		bits &= bits - 1;
+	}
+	return false;
+}
+
+static bool literals_find_from(const udfa_cpu_literals *lit, const symbol *input, unsigned int p, unsigned int size){
+	for (; p + lit->n_fingerprint <= size; p++) {
+		unsigned int bits = 0xFF;
+		for (unsigned int k = 0; k < lit->n_fingerprint && bits; k++)
+			bits &= lit->lo[k][input[p + k] & 15] & lit->hi[k][input[p + k] >> 4];
+		if (bits && literals_verify(lit, bits, input, p, size))
+			return true;
+	}
+	return false;
+}
+
+static bool literals_find_scalar(const udfa_cpu_literals *lit, const symbol *input, unsigned int size){
+	return literals_find_from(lit, input, 0, size);
+}
+/*--------------------------------------------------------------------------------------------------*/
+//Teddy: 32 candidate positions per step, the bucket bits of position p + i ending up in byte i of v_bits
+template<unsigned int N>
+__attribute__((target("avx2")))
+static bool literals_find_avx2_fingerprint(const udfa_cpu_literals *lit, const symbol *input, unsigned int size){
+	__m256i v_lo[N], v_hi[N];
+	for (unsigned int k = 0; k < N; k++) {
+		v_lo[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lit->lo[k]));
+		v_hi[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lit->hi[k]));
+	}
+	const __m256i v_nibble = _mm256_set1_epi8(0x0F);
+	const __m256i v_zero   = _mm256_setzero_si256();
+	unsigned int p = 0;
+	for (; p + 32 + N - 1 <= size; p += 32) {
+		__m256i v_bits = _mm256_set1_epi8((char)0xFF);
+		for (unsigned int k = 0; k < N; k++) {
+			__m256i v_in  = _mm256_loadu_si256((const __m256i *)(input + p + k));
+			__m256i v_lob = _mm256_shuffle_epi8(v_lo[k], _mm256_and_si256(v_in, v_nibble));
+			__m256i v_hib = _mm256_shuffle_epi8(v_hi[k], _mm256_and_si256(_mm256_srli_epi16(v_in, 4), v_nibble));
+			v_bits = _mm256_and_si256(v_bits, _mm256_and_si256(v_lob, v_hib));
+		}
+		unsigned int candidates = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(v_bits, v_zero));
+		if (candidates == 0)
+			continue;
+		symbol bits[32];
+		_mm256_storeu_si256((__m256i *)bits, v_bits);
+		while (candidates) {
+			unsigned int i = __builtin_ctz(candidates);
+			if (literals_verify(lit, bits[i], input, p + i, size))
+				return true;
+			candidates &= candidates - 1;
+		}
+	}
+	return literals_find_from(lit, input, p, size);
+}
+
+static bool literals_find_avx2(const udfa_cpu_literals *lit, const symbol *input, unsigned int size){
+	switch (lit->n_fingerprint) {
+		case 1:  return literals_find_avx2_fingerprint<1>(lit, input, size);
+		case 2:  return literals_find_avx2_fingerprint<2>(lit, input, size);
+		default: return literals_find_avx2_fingerprint<3>(lit, input, size);
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+typedef struct _simd_dispatch{
+	gather_kernel_t  gather_kernel;
+	packets_kernel_t packets_kernel;
+	accel_skip_t     accel_skip;
+	literals_find_t  literals_find;
+	unsigned int     lanes;
+	const char      *isa_name;
+} simd_dispatch;
+
+static simd_dispatch simd_detect(){
+	simd_dispatch d;
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		d.gather_kernel  = gather_kernel_avx512;
+		d.packets_kernel = packets_kernel_avx512;
+		d.accel_skip     = accel_skip_avx2;
+		d.literals_find  = literals_find_avx2;
+		d.lanes          = 16;
+		d.isa_name       = "AVX-512";
+	}
+	else if (__builtin_cpu_supports("avx2")) {
+		d.gather_kernel  = gather_kernel_avx2;
+		d.packets_kernel = packets_kernel_avx2;
+		d.accel_skip     = accel_skip_avx2;
+		d.literals_find  = literals_find_avx2;
+		d.lanes          = 8;
+		d.isa_name       = "AVX2";
+	}
+	else {
+		d.gather_kernel  = gather_kernel_scalar;
+		d.packets_kernel = packets_kernel_scalar;
+		d.accel_skip     = accel_skip_scalar;
+		d.literals_find  = literals_find_scalar;
+		d.lanes          = 8;
+		d.isa_name       = "scalar";
+	}
+	return d;
+}
+
+static const simd_dispatch &simd(){
+	static const simd_dispatch d = simd_detect();//detected once, thread-safe initialization
+	return d;
+}
+/*--------------------------------------------------------------------------------------------------*/
+unsigned int udfa_simd_lanes(){
+	return simd().lanes;
+}
+/*--------------------------------------------------------------------------------------------------*/
+const char *udfa_simd_isa_name(){
+	return simd().isa_name;
+}
+/*--------------------------------------------------------------------------------------------------*/
+void udfa_cpu_kernel_gather(
+				const char *dfa_state_tables, const unsigned int *accum_dfa_state_table_offsets,
+				const unsigned int *state_widths, const unsigned int *row_strides, const unsigned int *accept_offsets, const int *dead_states, const int *alphabet_cols, unsigned int n_dfas,
+				const symbol *input, unsigned int cur_pkt_size,
+				unsigned int *match_count, unsigned int count_stride,
+				match_type *match_array, size_t array_stride, unsigned int match_vec_size){
+	simd().gather_kernel(dfa_state_tables, accum_dfa_state_table_offsets, state_widths, row_strides, accept_offsets, dead_states, alphabet_cols, n_dfas, input, cur_pkt_size,
+	                     match_count, count_stride, match_array, array_stride, match_vec_size);
+}
+/*--------------------------------------------------------------------------------------------------*/
+unsigned int udfa_cpu_accel_skip(const accel_type *accel, const symbol *input, unsigned int p, unsigned int size){
+	return simd().accel_skip(accel, input, p, size);
+}
+/*--------------------------------------------------------------------------------------------------*/
+void udfa_cpu_kernel_packets(
+				const udfa_cpu_dfa *dfa,
+				const symbol *payloads, const size_t *pkt_offsets, const unsigned int *pkt_sizes,
+				unsigned int first_pkt, unsigned int n_pkts,
+				unsigned int *match_count, match_type *match_array, unsigned int match_vec_size){
+	//byte indices of the gathers are signed 32-bit, relative to the first packet of a call: the packets are cut
+	//into runs spanning at most 2 GB (a packet is at most 2 GB, so each run holds one at least)
+	unsigned int end_pkt = first_pkt + n_pkts;
+	while (first_pkt < end_pkt) {
+		unsigned int last = first_pkt + 1;
+		while (last < end_pkt && pkt_offsets[last] + pkt_sizes[last] - pkt_offsets[first_pkt] <= 0x80000000u)
+			last++;
+		simd().packets_kernel(dfa, payloads, pkt_offsets, pkt_sizes, first_pkt, last - first_pkt,
+		                      match_count, match_array, match_vec_size);
+		first_pkt = last;
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+void udfa_cpu_literals_init(udfa_cpu_literals *lit, const std::vector<std::pair<std::string, bool> > &literals){
+	std::vector<std::pair<std::string, bool> > folded(literals);
+	for (unsigned int i = 0; i < folded.size(); i++)
+		if (folded[i].second)
+			for (unsigned int k = 0; k < folded[i].first.size(); k++)
+				folded[i].first[k] = fold_case(folded[i].first[k]);
+	//sorted, so that the literals of a bucket tend to share their leading bytes
+	std::sort(folded.begin(), folded.end());
+	folded.erase(std::unique(folded.begin(), folded.end()), folded.end());
+
+	std::vector<std::pair<std::string, bool> > kept;
+	for (unsigned int i = 0; i < folded.size(); i++) {
+		bool implied = false;
+		for (unsigned int j = 0; j < folded.size() && !implied; j++) {
+			if (j == i || folded[j].first.size() > folded[i].first.size() || (!folded[j].second && folded[i].second))
+				continue;//a case-sensitive literal does not cover a case-insensitive one
+			std::string haystack = folded[i].first;
+			if (folded[j].second)
+				for (unsigned int k = 0; k < haystack.size(); k++)
+					haystack[k] = fold_case(haystack[k]);
+			implied = (haystack.find(folded[j].first) != std::string::npos);
+		}
+		if (!implied)
+			kept.push_back(folded[i]);
+	}
+
+	lit->n_fingerprint = kept.empty() ? 0 : SIMD_LITERAL_FINGERPRINT;
+	for (unsigned int i = 0; i < kept.size(); i++)
+		if (kept[i].first.size() < lit->n_fingerprint)
+			lit->n_fingerprint = kept[i].first.size();
+	memset(lit->lo, 0, sizeof(lit->lo));
+	memset(lit->hi, 0, sizeof(lit->hi));
+	for (unsigned int b = 0; b < SIMD_LITERAL_BUCKETS; b++)
+		lit->bucket[b].clear();
+	for (unsigned int i = 0; i < kept.size(); i++) {
+		unsigned int b = (size_t)i * SIMD_LITERAL_BUCKETS / kept.size();
+		lit->bucket[b].push_back(kept[i]);
+		for (unsigned int k = 0; k < lit->n_fingerprint; k++) {
+			symbol c = kept[i].first[k];
+			lit->lo[k][c & 15] |= 1 << b;
+			lit->hi[k][c >> 4] |= 1 << b;
+			if (kept[i].second && c >= 'a' && c <= 'z') {
+				c -= 'a' - 'A';
+				lit->lo[k][c & 15] |= 1 << b;
+				lit->hi[k][c >> 4] |= 1 << b;
+			}
+		}
+	}
+}
+/*--------------------------------------------------------------------------------------------------*/
+bool udfa_cpu_literals_find(const udfa_cpu_literals *lit, const symbol *input, unsigned int size){
+	return simd().literals_find(lit, input, size);
+}
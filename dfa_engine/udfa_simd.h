@@ -0,0 +1,70 @@
+/*
+ * Vinh Dang
+ * vqd8a@virginia.edu
+ *
+ * UDFA SIMD Object
+ */
+
+#ifndef UDFA_SIMD_H
+#define UDFA_SIMD_H
+
+#include <string>
+#include <vector>
+#include "common.h"
+#include "udfa_cpu.h"
+
+#define SIMD_MAX_LANES 16 //AVX-512: sixteen 32-bit states per vector
+#define SIMD_PACKET_TILE 16 //packets handed to udfa_cpu_kernel_packets per call, in multiples of the lane count
+#define SIMD_LITERAL_BUCKETS 8 //bits of the nibble masks of the literal search
+#define SIMD_LITERAL_FINGERPRINT 3 //leading bytes of the literals checked by the nibble masks
+
+//required literals of a DFA group, searched Teddy-style: the literals are spread over SIMD_LITERAL_BUCKETS buckets,
+//and position p is a candidate for a bucket when the low and high nibbles of input[p+k] both have the bucket bit
+//set in the masks of fingerprint byte k, for every k < n_fingerprint. Candidates are verified against the literals
+//of their buckets (case-insensitive ones are stored lowercase)
+typedef struct _udfa_cpu_literals{
+	unsigned int n_fingerprint;//at most the length of the shortest literal; 0 - no literals, nothing to search
+	symbol       lo[SIMD_LITERAL_FINGERPRINT][16];
+	symbol       hi[SIMD_LITERAL_FINGERPRINT][16];
+	std::vector<std::pair<std::string, bool> > bucket[SIMD_LITERAL_BUCKETS];//literal, case-insensitive
+} udfa_cpu_literals;
+
+//lanes per vector of the SIMD kernels on this machine (16 - AVX-512, 8 - AVX2 or scalar fallback)
+unsigned int udfa_simd_lanes();
+const char *udfa_simd_isa_name();
+
+//CPU counterpart of the grid.y dimension: scans one packet with n_dfas (<= udfa_simd_lanes()) DFAs at once,
+//one DFA per vector lane, over the concatenated tables (DFA i starts accum_dfa_state_table_offsets[i] bytes in,
+//with state_widths[i]-byte entries, and sizeof(state_t) readable bytes must follow the last table).
+//Entries of DFA i step with row stride row_strides[i] and are accepting from accept_offsets[i] on; alphabet_cols[c*SIMD_MAX_LANES + i] is the column of symbol c in DFA i.
+//The scan stops early once every DFA sits in its dead state dead_states[i] (-1 if none).
+//The match counter/array of lane i are match_count[i*count_stride] and match_array[i*array_stride]
+void udfa_cpu_kernel_gather(
+				const char *dfa_state_tables, const unsigned int *accum_dfa_state_table_offsets,
+				const unsigned int *state_widths, const unsigned int *row_strides, const unsigned int *accept_offsets, const int *dead_states, const int *alphabet_cols, unsigned int n_dfas,
+				const symbol *input, unsigned int cur_pkt_size,
+				unsigned int *match_count, unsigned int count_stride,
+				match_type *match_array, size_t array_stride, unsigned int match_vec_size);
+
+//CPU counterpart of the grid.x dimension: scans packets first_pkt .. first_pkt+n_pkts-1 with one DFA,
+//one packet per vector lane; a lane that reaches the end of its packet or the dead state of the DFA is masked
+//off and refilled with the next packet. Packet sizes must be multiples of fetch_bytes (Packets pads them); packets
+//may start at any byte of payloads.
+//The match counter/array of packet j are match_count[j] and match_array[j*match_vec_size]
+void udfa_cpu_kernel_packets(
+				const udfa_cpu_dfa *dfa,
+				const symbol *payloads, const size_t *pkt_offsets, const unsigned int *pkt_sizes,
+				unsigned int first_pkt, unsigned int n_pkts,
+				unsigned int *match_count, match_type *match_array, unsigned int match_vec_size);
+
+//first position from p on (size if none) of input whose symbol may leave the accelerated state accel: an escape
+//symbol or, for some sets of more than 8 high nibbles, a symbol that loops too
+unsigned int udfa_cpu_accel_skip(const accel_type *accel, const symbol *input, unsigned int p, unsigned int size);
+
+//builds the search for literals (literal, case-insensitive); a literal that contains another one is left out,
+//since a packet holding it holds the other one too
+void udfa_cpu_literals_init(udfa_cpu_literals *lit, const std::vector<std::pair<std::string, bool> > &literals);
+
+//true if one of the literals occurs in input[0 .. size-1]
+bool udfa_cpu_literals_find(const udfa_cpu_literals *lit, const symbol *input, unsigned int size);
+#endif
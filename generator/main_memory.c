@@ -203,6 +203,7 @@ int main(int argc, char **argv){
 	FILE *aut_file = NULL;
 	FILE *aut_binfile = NULL; char fname1[500];
 	FILE *aut_accst_binfile = NULL; char fname2[500];
+	FILE *aut_litfile = NULL; char fname3[500];
 	FILE *dump_source = NULL;
 	char *trace_filename = NULL;
 	char *dump_filename = NULL;
@@ -275,6 +276,12 @@ int main(int argc, char **argv){
 					aut_accst_binfile=fopen(fname2,"wb");
 					if (aut_accst_binfile==NULL) fatal ("cannot create automaton-acceptingstate-binfile");
 					else printf("automaton accepting state binfile: %s\n",fname2);
+					
+					strcpy (fname3,argv[i]);
+					strcat (fname3,"litbin");
+					aut_litfile=fopen(fname3,"wb");
+					if (aut_litfile==NULL) fatal ("cannot create automaton-literal-binfile");
+					else printf("automaton required literal binfile: %s\n",fname3);
 				}
 			}
 		}else if (strcmp(argv[i],"-I")==0) {
@@ -455,6 +462,10 @@ int main(int argc, char **argv){
 				//regex_parser *parser=new regex_parser(false,true);
 				regex_parser *parser=new regex_parser(imod_bool,true);
 				nfa = parser->parse(regex_file);
+				if (aut_litfile!=NULL){
+					parser->required_literals(regex_file, aut_litfile);
+					fclose(aut_litfile);
+				}
 				delete parser;
 				fclose(regex_file);
 			}
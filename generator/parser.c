@@ -490,3 +490,119 @@ int regex_parser::process_range(NFA **fa, NFA **to_link, const char *re, int ptr
 	delete range;
 	return ptr;
 }
+
+/* Required literals (prefilter of the DFA engine) */
+
+//skips the quantifier at re[ptr] (*, +, ?, {lb,ub}) and returns the position after it
+int regex_parser::skip_quantifier(const char *re, int ptr){
+	if (re[ptr]!=OPEN_QBRACKET) return ptr+1;
+	int lb, ub;
+	return process_quantifier(re,ptr+1,&lb,&ub);
+}
+
+//skips the character range starting after the [ at re[ptr] and returns the position after its ]
+int regex_parser::skip_range(const char *re, int ptr){
+	if (re[ptr]==TILDE) ptr++;
+	while(ptr!=strlen(re)-1 && re[ptr]!=CLOSE_SBRACKET){
+		if (re[ptr]==ESCAPE){
+			int_set *chars=new int_set(CSIZE);
+			ptr=process_escape(re,ptr+1,chars);
+			delete chars;
+		}else
+			ptr++;
+	}
+	return ptr+1;
+}
+
+int regex_parser::required_literal(const char *re, char *literal){
+	int ptr=0;
+	int len=strlen(re);
+	int best=0;  //length of the longest run so far, kept in literal
+	int run=0;   //length of the current run of single characters
+	char *run_chars=allocate_char_array(len+1);
+	if (re[ptr]==TILDE) ptr++;
+	while(ptr<len){
+		int c=-1;  //single character matched by the next atom, -1 if it matches a set or a sub-expression
+		if(re[ptr]==ESCAPE){
+			int_set *chars=new int_set(CSIZE);
+			ptr=process_escape(re,ptr+1,chars);
+			if (chars->size()==1) c=chars->head();
+			delete chars;
+		}else if(!is_special(re[ptr])){
+			c=(unsigned char)re[ptr++];
+		}else if(re[ptr]==OPEN_SBRACKET){
+			ptr=skip_range(re,ptr+1);
+		}else if(re[ptr]==OPEN_RBRACKET){
+			int depth=1;
+			ptr++;
+			while(ptr<len && depth>0){
+				if (re[ptr]==ESCAPE){
+					int_set *chars=new int_set(CSIZE);
+					ptr=process_escape(re,ptr+1,chars);
+					delete chars;
+				}else if (re[ptr]==OPEN_SBRACKET){
+					ptr=skip_range(re,ptr+1);
+				}else{
+					if (re[ptr]==OPEN_RBRACKET) depth++;
+					if (re[ptr]==CLOSE_RBRACKET) depth--;
+					ptr++;
+				}
+			}
+		}else if(re[ptr]==OR){
+			best=run=0; //alternatives: no run is required by all of them
+			break;
+		}else if(re[ptr]==CLOSE_RBRACKET){
+			break; //parse_re stops here
+		}else if(!is_repetition(re[ptr])){
+			ptr++; //ANY
+		}
+		//a quantified atom may be left out or repeated: it ends the run
+		bool quantified=false;
+		while(ptr<len && is_repetition(re[ptr])){
+			ptr=skip_quantifier(re,ptr);
+			quantified=true;
+		}
+		if (c!=-1 && !quantified){
+			run_chars[run++]=c;
+		}else{
+			if (run>best){ memcpy(literal,run_chars,run); best=run; }
+			run=0;
+		}
+	}
+	if (run>best){ memcpy(literal,run_chars,run); best=run; }
+	free(run_chars);
+	return best;
+}
+
+void regex_parser::required_literals(FILE *file, FILE *lit_file){
+	rewind(file);
+	char *re=allocate_char_array(1000);
+	char *literal=allocate_char_array(1000);
+	int i=0;
+	unsigned int rule=0; //rules are numbered like NFA::accept does, from 1 in file order
+	unsigned int flags=i_modifier ? 1 : 0; //1: letters match in either case
+	unsigned int c=fgetc(file);
+	while(1){
+		if (c==EOF || c=='\n' || c=='\r'){
+			if(i!=0){
+				re[i]='\0';
+				if (re[0]!='#'){
+					rule++;
+					unsigned int len=required_literal(re,literal);
+					fwrite(&rule, sizeof(unsigned int), 1, lit_file);
+					fwrite(&flags, sizeof(unsigned int), 1, lit_file);
+					fwrite(&len, sizeof(unsigned int), 1, lit_file);
+					fwrite(literal, 1, len, lit_file);
+					if (DEBUG) fprintf(stdout,"%d) required literal of <%s>: %d bytes\n",rule,re,len);
+				}
+				i=0;
+			}
+			if (c==EOF) break;
+		}else{
+			re[i++]=c;
+		}
+		c=fgetc(file);
+	}
+	free(re);
+	free(literal);
+}
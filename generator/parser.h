@@ -93,6 +93,10 @@ public:
 	//parses all the regular expressions containted in file and returns a set of DFAs
 	dfa_set *parse_to_dfa(FILE *file);
 	
+	//writes to lit_file, for every regular expression in file, the longest string that all its matches contain
+	//(rule number, flags - 1: case insensitive, length, characters; length 0 if there is none)
+	void required_literals(FILE *file, FILE *lit_file);
+	
 private:
 
 	//parses a regular expressions into the given NFA
@@ -109,6 +113,13 @@ private:
 
 	//process a range of characters ([-])
 	int process_range(NFA **fa, NFA **to_link, const char *re, int ptr);
+
+	//skips a quantifier / a range of characters without building its NFA
+	int skip_quantifier(const char *re, int ptr);
+	int skip_range(const char *re, int ptr);
+	
+	//longest run of single characters outside sub-expressions in a regular expression: every match contains it
+	int required_literal(const char *re, char *literal);
 	
 };
 